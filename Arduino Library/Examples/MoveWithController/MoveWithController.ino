@@ -33,7 +33,6 @@ byte buff[NUM_CHARS]; //buffer to save the message
 uint8_t open_close, options;
 uint8_t moveOption = USER_FRIENDLY;
 int vx, vy, vz, vg, vq5;
-long initial_time;
 
 /*
     BUFFER MESSAGE
@@ -57,6 +56,7 @@ long initial_time;
                     5 --> torque
                     6 --> moveOption = POINT_MOVEMENT
                     7 --> moveOption = USER_FRIENDLY
+                    8 --> print and clear the profile (WIDOWX_PROFILE)
                     other --> void
 */
 
@@ -89,42 +89,40 @@ void loop() {
   if(Serial.available())
   {
     Serial.readBytes(buff, NUM_CHARS);
-    initial_time = millis();
     options = buff[5] & 0xF; //Get options bits
     
     if (options == 0) //No given option (higher priority)
     {
-        vx = buff[0] & 0x7F;
-        if (buff[0] >> 7)
-            vx = -vx;
+        {
+            PROFILE_SCOPE(PROBE_PARSER);
+            vx = buff[0] & 0x7F;
+            if (buff[0] >> 7)
+                vx = -vx;
 
-        vy = buff[1] & 0x7F;
-        if (buff[1] >> 7)
-            vy = -vy;
+            vy = buff[1] & 0x7F;
+            if (buff[1] >> 7)
+                vy = -vy;
 
-        vz = buff[2] & 0x7F;
-        if (buff[2] >> 7)
-            vz = -vz;
+            vz = buff[2] & 0x7F;
+            if (buff[2] >> 7)
+                vz = -vz;
 
-        vg = buff[3];
-        vq5 = buff[4];
+            vg = buff[3];
+            vq5 = buff[4];
 
-        if (buff[5] >> 7) //Sg
-            vg = -vg;
-        if ((buff[5] >> 6) & 1) //Sq5
-            vq5 = -vq5;
-            
-        delay(5);
-        if (vq5)
-            widow.moveServoWithSpeed(4, vq5, initial_time);
-        if (vx || vy || vz || vg)
-        {
-          if(moveOption)
-            widow.movePointWithSpeed(vx, vy, vz, vg, initial_time);
-          else
-            widow.moveArmWithSpeed(vx, vy, vz, vg, initial_time);
+            if (buff[5] >> 7) //Sg
+                vg = -vg;
+            if ((buff[5] >> 6) & 1) //Sq5
+                vq5 = -vq5;
         }
             
+        //Called on every frame, so the speeds are integrated over the time between frames
+        widow.moveServoWithSpeed(4, vq5);
+        if(moveOption)
+          widow.movePointWithSpeed(vx, vy, vz, vg);
+        else
+          widow.moveArmWithSpeed(vx, vy, vz, vg);
+            
         
         open_close = (buff[5] >> 4) & 0b11;
         switch (open_close)
@@ -164,6 +162,10 @@ void loop() {
         case 7:
             moveOption = USER_FRIENDLY;
             break;
+        case 8:
+            profileDump();
+            profileReset();
+            break;
         default:
             break;
         }
@@ -9,7 +9,7 @@ void setup()
     Serial.println("...Starting Robotic Arm...");
     delay(1000);
     widow.init(0); //Check voltage, move to rest and do not relax the servos
-    delay(2000);
+    widow.setArrivalTolerance(10, 2000); //Every move returns once the arm is there
     Serial.println("...Moving Home...");
     widow.moveHome();
     Serial.println("...Moving to Center...");
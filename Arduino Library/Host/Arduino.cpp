@@ -0,0 +1,109 @@
+/*
+Arduino.cpp - Host (Linux) replacement of the Arduino core used by the WidowX library
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <time.h>
+#include "Arduino.h"
+#include "avr/eeprom.h"
+
+HardwareSerial Serial;
+
+static struct timespec monotonicNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+/*
+ * Microseconds since the first time the clock was read, from the monotonic clock of the host.
+ * The start is a static initialized by its first call, which C++11 guarantees to happen once 
+ * even when several threads read the clock at the same time (the Workspace tool constructs a 
+ * WidowX on every thread). It is not a global, since global WidowX objects read the clock in
+ * their constructor, possibly before the globals of this file are initialized
+*/
+unsigned long micros()
+{
+    static const struct timespec start = monotonicNow();
+    const struct timespec now = monotonicNow();
+    return (now.tv_sec - start.tv_sec) * 1000000UL + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+    struct timespec t = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+    nanosleep(&t, NULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    struct timespec t = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000L};
+    nanosleep(&t, NULL);
+}
+
+//EEPROM of the ATmega644p: 2KB, erased
+uint8_t eeprom[E2END + 1];
+uint8_t eeprom_ready = 0;
+
+uint8_t *eepromAddress(const void *address)
+{
+    if (!eeprom_ready)
+    {
+        memset(eeprom, 0xFF, sizeof(eeprom));
+        eeprom_ready = 1;
+    }
+    return eeprom + ((size_t)address & E2END);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        ((uint8_t *)dst)[i] = *eepromAddress((const uint8_t *)src + i);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        *eepromAddress((uint8_t *)dst + i) = ((const uint8_t *)src)[i];
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+    eeprom_update_block(src, dst, n);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    return *eepromAddress(address);
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+    *eepromAddress(address) = value;
+}
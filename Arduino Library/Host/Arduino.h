@@ -0,0 +1,90 @@
+/*
+Arduino.h - Host (Linux) replacement of the Arduino core used by the WidowX library
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <cstdlib>
+
+using std::abs;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+//The Arduino core defines them as macros; templates do not break the standard headers.
+//As the macros, they return the type that mixing both arguments gives
+template <class T, class U>
+inline auto min(T a, U b) -> decltype(a + b) { return a < b ? a : b; }
+template <class T, class U>
+inline auto max(T a, U b) -> decltype(a + b) { return a > b ? a : b; }
+
+#define noInterrupts()
+#define interrupts()
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/*
+ * Serial port of the host: everything printed goes to stdout (or to the file given to 
+ * setOutput) and nothing is ever received
+*/
+class HardwareSerial
+{
+public:
+    HardwareSerial() : out(stdout) {}
+    void setOutput(FILE *file) { out = file; }
+    void begin(long baud) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void print(const char *s) { fputs(s, out); }
+    void print(char c) { fputc(c, out); }
+    void print(int n) { fprintf(out, "%d", n); }
+    void print(unsigned int n) { fprintf(out, "%u", n); }
+    void print(long n) { fprintf(out, "%ld", n); }
+    void print(unsigned long n) { fprintf(out, "%lu", n); }
+    void print(double n, int digits = 2) { fprintf(out, "%.*f", digits, n); }
+    void println() { fputc('\n', out); }
+    template <class T>
+    void println(T value)
+    {
+        print(value);
+        println();
+    }
+    void println(double n, int digits) { print(n, digits); println(); }
+
+private:
+    FILE *out;
+};
+
+extern HardwareSerial Serial;
+
+#endif
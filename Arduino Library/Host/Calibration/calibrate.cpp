@@ -0,0 +1,203 @@
+/*
+calibrate.cpp - Fits the calibration of the servos of a WidowX from measured angles
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <vector>
+#include "WidowX.h"
+
+//Nominal conversion of each servo, as in WidowX.cpp: radians per position and position of 0 rad
+const float nominal_gain[] = {0.00153435538637, -0.00153435538637, 0.00153435538637, 0.00153435538637,
+                              0.00511826979472, 0.00511826979472};
+const float nominal_zero[] = {2047.5, 2047.5, 2047.5, 2047.5, 511.5, 511.5};
+
+struct Sample
+{
+    int position;
+    double angle;
+};
+
+/*
+ * Fits angle = scale * nominal + offset by least squares. Returns 1 if the samples do not 
+ * have at least two different positions
+*/
+uint8_t fitLine(int idx, const std::vector<Sample> &samples, double *offset, double *scale)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    const size_t n = samples.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        const double x = nominal_gain[idx] * (samples[i].position - nominal_zero[idx]);
+        sx += x;
+        sy += samples[i].angle;
+        sxx += x * x;
+        sxy += x * samples[i].angle;
+    }
+    const double det = n * sxx - sx * sx;
+    if (n < 2 || abs(det) < 1e-12)
+        return 1;
+    *scale = (n * sxy - sx * sy) / det;
+    *offset = (sy - *scale * sx) / n;
+    return 0;
+}
+
+/*
+ * Position, as the library computes it without table, where the servo should be to reach the
+ * angle with the fitted line
+*/
+double linePosition(int idx, double angle, double offset, double scale)
+{
+    return (angle - offset) / (scale * nominal_gain[idx]) + nominal_zero[idx];
+}
+
+/*
+ * Fits the table of corrections to what the line leaves: each point is the average of the 
+ * residuals around it, weighted by how close they are (the same linear interpolation the 
+ * library uses). Points without samples nearby stay at 0
+*/
+void fitTable(int idx, const std::vector<Sample> &samples, double offset, double scale, int8_t *table)
+{
+    const double last = idx < 4 ? 4095 : 1023;
+    double sum[CAL_LUT_POINTS] = {0}, weight[CAL_LUT_POINTS] = {0};
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        const double residual = samples[i].position - linePosition(idx, samples[i].angle, offset, scale);
+        double x = samples[i].position * (CAL_LUT_POINTS - 1) / last;
+        x = min(max(x, 0.0), CAL_LUT_POINTS - 1.0);
+        const int k = min((int)x, CAL_LUT_POINTS - 2);
+        const double f = x - k;
+        sum[k] += (1 - f) * residual;
+        weight[k] += 1 - f;
+        sum[k + 1] += f * residual;
+        weight[k + 1] += f;
+    }
+    for (int k = 0; k < CAL_LUT_POINTS; k++)
+    {
+        const double correction = weight[k] > 0 ? sum[k] / weight[k] : 0;
+        table[k] = (int8_t)min(max(round(correction), -128.0), 127.0);
+    }
+}
+
+double tableCorrection(int idx, const int8_t *table, double position)
+{
+    const double last = idx < 4 ? 4095 : 1023;
+    double x = min(max(position * (CAL_LUT_POINTS - 1) / last, 0.0), CAL_LUT_POINTS - 1.0);
+    const int k = min((int)x, CAL_LUT_POINTS - 2);
+    x -= k;
+    return table[k] + x * (table[k + 1] - table[k]);
+}
+
+/*
+ * Root mean square, in degrees, of the difference between the measured angles and the ones
+ * the library would compute from the positions
+*/
+double errorRMS(int idx, const std::vector<Sample> &samples, double offset, double scale, const int8_t *table)
+{
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        double position = samples[i].position;
+        if (table != NULL)
+            position -= tableCorrection(idx, table, position);
+        const double angle = scale * nominal_gain[idx] * (position - nominal_zero[idx]) + offset;
+        sum += pow(angle - samples[i].angle, 2);
+    }
+    return sqrt(sum / samples.size()) * 180 / M_PI;
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = NULL;
+    uint8_t use_tables = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-lut"))
+            use_tables = 1;
+        else
+            name = argv[i];
+    }
+    if (name == NULL)
+    {
+        fprintf(stderr, "Usage: %s [-lut] measurements.csv\n", argv[0]);
+        return 2;
+    }
+    FILE *file = fopen(name, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", name);
+        return 2;
+    }
+
+    //Every line: idx, position read from the servo, measured angle in degrees
+    std::vector<Sample> samples[6];
+    char line[128];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        int idx, position;
+        double degrees;
+        if (line[0] == '#' || sscanf(line, "%d , %d , %lf", &idx, &position, &degrees) != 3)
+            continue;
+        if (idx < 0 || idx > 5)
+        {
+            fprintf(stderr, "%s:%d: idx must be between 0 and 5\n", name, line_number);
+            continue;
+        }
+        Sample sample = {position, degrees * M_PI / 180};
+        samples[idx].push_back(sample);
+    }
+    fclose(file);
+
+    printf("//Calibration fitted from %s. Run once in setup() to save it in the EEPROM\n", name);
+    for (int idx = 0; idx < 6; idx++)
+    {
+        double offset = 0, scale = 1;
+        if (samples[idx].empty())
+            continue;
+        if (fitLine(idx, samples[idx], &offset, &scale))
+        {
+            fprintf(stderr, "Servo %d: at least two different positions are needed\n", idx);
+            continue;
+        }
+        const double before = errorRMS(idx, samples[idx], 0, 1, NULL);
+        const double after = errorRMS(idx, samples[idx], offset, scale, NULL);
+        printf("//Servo %d: %zu samples, RMS error %.3f° nominal, %.3f° calibrated", idx, samples[idx].size(), before, after);
+        int8_t table[CAL_LUT_POINTS];
+        if (use_tables)
+        {
+            fitTable(idx, samples[idx], offset, scale, table);
+            printf(", %.3f° with table", errorRMS(idx, samples[idx], offset, scale, table));
+        }
+        printf("\nwidow.setCalibration(%d, %.6f, %.6f);\n", idx, offset, scale);
+        if (use_tables)
+        {
+            printf("const int8_t table%d[CAL_LUT_POINTS] = {", idx);
+            for (int k = 0; k < CAL_LUT_POINTS; k++)
+                printf(k ? ", %d" : "%d", table[k]);
+            printf("};\nwidow.setCalibrationTable(%d, table%d);\n", idx, idx);
+        }
+    }
+    printf("widow.saveCalibration();\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+motion.cpp - Checks the non-blocking motion functions of the WidowX library on the host
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include "WidowX.h"
+
+//Longest a test may take, in calls to the update functions, before it is taken as stuck
+#define MAX_UPDATES 1000000L
+
+WidowX widow = WidowX();
+int failures = 0;
+
+/*
+ * Prints the result of a check and counts the failures
+*/
+void check(const char *name, int passed, const char *format, double value)
+{
+    printf("%-40s %s (", name, passed ? "PASS" : "FAIL");
+    printf(format, value);
+    printf(")\n");
+    if (!passed)
+        failures++;
+}
+
+/*
+ * Distance from the point where the arm is now to the target [cm]
+*/
+double distanceTo(const float *target)
+{
+    float p[3];
+    widow.getPoint(p);
+    return sqrt(pow(p[0] - target[0], 2) + pow(p[1] - target[1], 2) + pow(p[2] - target[2], 2));
+}
+
+/*
+ * Runs the motion queue with updateQueue() until it is empty. Returns the virtual milliseconds it
+ * took, or -1 if it did not finish within MAX_UPDATES calls
+*/
+long runQueued(const float targets[][4], int count, int time, float tolerance)
+{
+    for (int i = 0; i < count; i++)
+        widow.queueArmGamma(targets[i][0], targets[i][1], targets[i][2], targets[i][3], time, tolerance);
+    const unsigned long start = clockMillis();
+    for (long n = 0; n < MAX_UPDATES; n++)
+        if (!widow.updateQueue())
+            return clockMillis() - start;
+    widow.clearQueue();
+    return -1;
+}
+
+int main()
+{
+    setVirtualClock(1);
+    widow.init(0);
+    const float targets[][4] = {{20, 0, 25, 0}, {25, 5, 15, 0.5}, {20, -5, 20, 0}};
+    const int time = 1000;
+    long elapsed;
+
+    //updateMotion() has to move the virtual clock forward on its own
+    widow.retargetArmGamma(targets[0][0], targets[0][1], targets[0][2], targets[0][3], time);
+    unsigned long start = clockMillis();
+    long n = 0;
+    while (widow.isMoving() && n < MAX_UPDATES)
+    {
+        widow.updateMotion();
+        n++;
+    }
+    elapsed = clockMillis() - start;
+    check("updateMotion finishes", !widow.isMoving(), "%.0f ms", elapsed);
+    check("updateMotion takes the move time", abs(elapsed - time) <= 20, "%.0f ms", elapsed);
+    check("updateMotion reaches the goal", distanceTo(targets[0]) < 0.2, "%.3f cm", distanceTo(targets[0]));
+
+    //The queue stops at every goal without tolerance, and blends into the next one with it
+    elapsed = runQueued(targets, 3, time, 0);
+    check("Queue finishes", elapsed >= 0, "%.0f ms", elapsed);
+    check("Queue without blending", elapsed >= 3 * time, "%.0f ms", elapsed);
+    check("Queue reaches the last goal", distanceTo(targets[2]) < 0.2, "%.3f cm", distanceTo(targets[2]));
+
+    elapsed = runQueued(targets, 3, time, 2);
+    check("Blended queue finishes", elapsed >= 0, "%.0f ms", elapsed);
+    check("Blended queue is shorter", elapsed >= 0 && elapsed < 3 * time, "%.0f ms", elapsed);
+    check("Blended queue reaches the last goal", distanceTo(targets[2]) < 0.2, "%.3f cm", distanceTo(targets[2]));
+
+    //The bias of the gravity compensation (about 3cm at these goals with 500g) is not part of
+    //the distance to the goal
+    widow.setGravityCompensation(1, 0);
+    widow.setPayload(500);
+    elapsed = runQueued(targets, 3, time, 1);
+    check("Blending with gravity compensation", elapsed >= 0 && elapsed < 3 * time, "%.0f ms", elapsed);
+    widow.setGravityCompensation(0, 0);
+    widow.setPayload(0);
+
+    //runQueue() blocks until the queue is done
+    for (int i = 0; i < 3; i++)
+        widow.queueArmGamma(targets[i][0], targets[i][1], targets[i][2], targets[i][3], time, 2);
+    start = clockMillis();
+    widow.runQueue();
+    elapsed = clockMillis() - start;
+    check("runQueue empties the queue", widow.queueLength() == 0 && !widow.isMoving(), "%.0f ms", elapsed);
+
+    //With servos that take time to move, the end of the move is polled, not waited for
+    ax12SetClock(clockMicros);
+    widow.setArrivalTolerance(5, 2000);
+    widow.retargetArmGamma(targets[1][0], targets[1][1], targets[1][2], targets[1][3], 200);
+    start = clockMillis();
+    unsigned long longest = 0, previous = start;
+    n = 0;
+    while (widow.updateMotion() && n < MAX_UPDATES)
+    {
+        longest = max(longest, clockMillis() - previous);
+        previous = clockMillis();
+        n++;
+    }
+    elapsed = clockMillis() - start;
+    check("Settling finishes", !widow.isMoving(), "%.0f ms", elapsed);
+    check("Settling does not block", longest <= 20, "%.0f ms", longest);
+    check("Arm arrives before the timeout", widow.getSettleTime() >= 0, "%.0f ms", widow.getSettleTime());
+    check("Settling reaches the goal", distanceTo(targets[1]) < 0.2, "%.3f cm", distanceTo(targets[1]));
+    widow.setArrivalTolerance(0, 0);
+    ax12SetClock(NULL);
+
+    //A move of no time writes its goal at once, without planning a trajectory to shape
+    widow.setInputShaper(SHAPER_ZV, 4, 0.05);
+    widow.retargetArmGamma(targets[0][0], targets[0][1], targets[0][2], targets[0][3], time);
+    for (n = 0; n < 100; n++)
+        widow.updateMotion();
+    widow.retargetArmGamma(targets[2][0], targets[2][1], targets[2][2], targets[2][3], 0);
+    start = clockMillis();
+    n = 0;
+    while (widow.updateMotion() && n < MAX_UPDATES)
+        n++;
+    elapsed = clockMillis() - start;
+    check("Move of no time ends at once", !widow.isMoving() && elapsed <= 20, "%.0f ms", elapsed);
+    check("Move of no time reaches the goal", distanceTo(targets[2]) < 0.2, "%.3f cm", distanceTo(targets[2]));
+    widow.setInputShaper(SHAPER_NONE, 0, 0);
+
+    printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/*
+pose.cpp - Compares getPose/solvePose with the product of the transforms of Matlab/WidowXFK.m
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <chrono>
+#include <random>
+#include <vector>
+#include "WidowX.h"
+
+//Dimensions of the arm [cm], as in the constructor of the class
+const float L0 = 9, L1 = 14, L2 = 5, L3 = 14, L4 = 14;
+const float D = sqrt(L1 * L1 + L2 * L2), a = atan2(L1, L2);
+
+/*
+ * Homogeneous transform with the Denavit-Hartenberg parameters, as MaTranH in WidowXFK.m
+*/
+Matrix<4, 4> MaTranH(float qi, float di, float alfai_1, float ai_1)
+{
+    const float c = cos(qi), s = sin(qi), ca = cos(alfai_1), sa = sin(alfai_1);
+    Matrix<4, 4> T = {c, -s, 0, ai_1,
+                      s * ca, c * ca, -sa, -di * sa,
+                      s * sa, c * sa, ca, di * ca,
+                      0, 0, 0, 1};
+    return T;
+}
+
+/*
+ * The chain of WidowXFK.m evaluated as it is written: seven 4x4 products
+*/
+Matrix<4, 4> chainFK(const float *q)
+{
+    Matrix<4, 4> Tb0 = {1, 0, 0, 0,
+                        0, 1, 0, 0,
+                        0, 0, 1, L0,
+                        0, 0, 0, 1};
+    Matrix<4, 4> T5t = {0, 0, -1, 0,
+                        0, 1, 0, 0,
+                        1, 0, 0, L4,
+                        0, 0, 0, 1};
+    return Tb0 * MaTranH(q[0], 0, 0, 0) * MaTranH(q[1] + a, 0, M_PI_2, 0) * MaTranH(q[2] - a, 0, 0, D) *
+           MaTranH(q[3] - M_PI_2, 0, 0, L3) * MaTranH(q[4], 0, -M_PI_2, 0) * T5t;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t count = argc > 1 ? atol(argv[1]) : 100000;
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> angle(-M_PI_2, M_PI_2);
+    std::vector<float> angles(5 * count);
+    for (size_t i = 0; i < angles.size(); i++)
+        angles[i] = angle(random);
+
+    WidowX widow = WidowX();
+    float p[3];
+    Matrix<3, 3> R;
+    double position_error = 0, rotation_error = 0;
+    for (size_t n = 0; n < count; n++)
+    {
+        const float *q = &angles[5 * n];
+        widow.solvePose(q, p, R);
+        Matrix<4, 4> T = chainFK(q);
+        for (int i = 0; i < 3; i++)
+        {
+            position_error = max(position_error, (double)abs(T(i, 3) - p[i]));
+            for (int j = 0; j < 3; j++)
+                rotation_error = max(rotation_error, (double)abs(T(i, j) - R(i, j)));
+        }
+    }
+    printf("%zu random poses. Largest difference: position %.7f cm, rotation %.7f\n", count, position_error, rotation_error);
+
+    typedef std::chrono::steady_clock Clock;
+    volatile float sink = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t n = 0; n < count; n++)
+    {
+        widow.solvePose(&angles[5 * n], p, R);
+        sink = p[0] + R(0, 0);
+    }
+    const double closed = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+    start = Clock::now();
+    for (size_t n = 0; n < count; n++)
+    {
+        Matrix<4, 4> T = chainFK(&angles[5 * n]);
+        sink = T(0, 3) + T(0, 0);
+    }
+    const double chain = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+    //sink only keeps the compiler from removing the loops
+    (void)sink;
+    printf("Closed form %.1f ns per pose, 4x4 chain %.1f ns per pose (%.1fx)\n", closed, chain, chain / closed);
+
+    return position_error > 1e-4 || rotation_error > 1e-5;
+}
@@ -0,0 +1,164 @@
+"""
+widowx.py - Python bindings to the kinematics of the WidowX library
+
+Loads libwidowx.so (built from the host version of the library, see Host/README.md) with
+ctypes. It looks for it in the environment variable WIDOWX_LIB and then next to this file.
+Angles are in radians and points in cm, as in the library.
+
+The batch functions take NumPy arrays of float32 in C order, or any other object with a
+writable buffer of floats (such as array.array('f')), and work on their memory without
+copying it. Arrays of another type are converted once.
+"""
+import ctypes
+import os
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+_path = os.environ.get('WIDOWX_LIB', os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libwidowx.so'))
+_lib = ctypes.CDLL(_path)
+
+_float_p = ctypes.POINTER(ctypes.c_float)
+_uint8_p = ctypes.POINTER(ctypes.c_uint8)
+
+_lib.widowx_new.restype = ctypes.c_void_p
+_lib.widowx_free.argtypes = [ctypes.c_void_p]
+_lib.widowx_ik_gamma.argtypes = [ctypes.c_void_p] + [ctypes.c_float] * 4 + [_float_p]
+_lib.widowx_ik_rd.argtypes = [ctypes.c_void_p] + [ctypes.c_float] * 3 + [_float_p, _float_p]
+_lib.widowx_fk.argtypes = [ctypes.c_void_p, _float_p, _float_p]
+_lib.widowx_pose.argtypes = [ctypes.c_void_p, _float_p, _float_p, _float_p]
+_lib.widowx_ik_branch.argtypes = [ctypes.c_void_p]
+_lib.widowx_limit_margin.argtypes = [ctypes.c_void_p, _float_p]
+_lib.widowx_limit_margin.restype = ctypes.c_float
+_lib.widowx_quantize.argtypes = [ctypes.c_void_p, _float_p, ctypes.c_int]
+_lib.widowx_set_calibration.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_float, ctypes.c_float]
+_lib.widowx_ik_gamma_batch.argtypes = [ctypes.c_void_p, _float_p, ctypes.c_size_t, _float_p, _uint8_p]
+_lib.widowx_ik_gamma_batch.restype = ctypes.c_size_t
+_lib.widowx_fk_batch.argtypes = [ctypes.c_void_p, _float_p, ctypes.c_size_t, _float_p]
+
+
+def _floats(values, count):
+    array = (ctypes.c_float * count)()
+    for i, v in enumerate(values):
+        array[i] = v
+    return array
+
+
+def _pointer(buffer, ctype, count, name):
+    """Pointer to the memory of buffer, which must hold at least count values of ctype"""
+    if numpy is not None and isinstance(buffer, numpy.ndarray):
+        if buffer.dtype != numpy.dtype(ctype) or not buffer.flags['C_CONTIGUOUS']:
+            raise TypeError('%s must be a C-contiguous array of %s' % (name, numpy.dtype(ctype)))
+        if buffer.size < count:
+            raise ValueError('%s is too small' % name)
+        return buffer.ctypes.data_as(ctypes.POINTER(ctype))
+    memory = memoryview(buffer).cast('B')
+    if memory.nbytes < count * ctypes.sizeof(ctype):
+        raise ValueError('%s is too small' % name)
+    return ctypes.cast((ctypes.c_char * memory.nbytes).from_buffer(memory), ctypes.POINTER(ctype))
+
+
+def _as_float32(array):
+    if numpy is not None and not (isinstance(array, numpy.ndarray) and array.dtype == numpy.float32):
+        return numpy.ascontiguousarray(array, dtype=numpy.float32)
+    if numpy is not None:
+        return numpy.ascontiguousarray(array)
+    return array
+
+
+def _rows(array, name):
+    if numpy is not None and isinstance(array, numpy.ndarray):
+        if array.ndim != 2 or array.shape[1] != 4:
+            raise ValueError('%s must have 4 columns' % name)
+        return array.shape[0]
+    size = memoryview(array).nbytes // ctypes.sizeof(ctypes.c_float)
+    if size % 4:
+        raise ValueError('%s must have 4 values per row' % name)
+    return size // 4
+
+
+class WidowX(object):
+    """Kinematics of one WidowX. Different instances can be used from different threads"""
+
+    def __init__(self):
+        self._handle = ctypes.c_void_p(_lib.widowx_new())
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            _lib.widowx_free(self._handle)
+            self._handle = None
+
+    def ik_gamma(self, x, y, z, gamma):
+        """Q1 to Q4 to reach the point with the angle gamma of the gripper, or None"""
+        angles = (ctypes.c_float * 4)()
+        if _lib.widowx_ik_gamma(self._handle, x, y, z, gamma, angles):
+            return None
+        return tuple(angles)
+
+    def ik_rd(self, x, y, z, Rd):
+        """Q1 to Q5 to reach the point with the rotation Rd (3x3, as seen from {1}), or None"""
+        angles = (ctypes.c_float * 5)()
+        R = _floats([Rd[i][j] for i in range(3) for j in range(3)], 9)
+        if _lib.widowx_ik_rd(self._handle, x, y, z, R, angles):
+            return None
+        return tuple(angles)
+
+    def fk(self, angles):
+        """Point and gamma (x, y, z, gamma) of the angles Q1 to Q4"""
+        pose = (ctypes.c_float * 4)()
+        _lib.widowx_fk(self._handle, _floats(angles, 4), pose)
+        return tuple(pose)
+
+    def pose(self, angles):
+        """Point (x, y, z) and rotation as seen from the base (3x3) of the angles Q1 to Q5"""
+        point = (ctypes.c_float * 3)()
+        R = (ctypes.c_float * 9)()
+        _lib.widowx_pose(self._handle, _floats(angles, 5), point, R)
+        return tuple(point), [list(R[3 * i:3 * i + 3]) for i in range(3)]
+
+    def ik_branch(self):
+        """Elbow solution of the last IK solved: 0 for the one tried first, 1 for the other"""
+        return _lib.widowx_ik_branch(self._handle)
+
+    def limit_margin(self, angles):
+        """Smallest distance from Q2, Q3 and Q4 to their limits [rad]"""
+        return _lib.widowx_limit_margin(self._handle, _floats(angles, 4))
+
+    def quantize(self, angles):
+        """The angles rounded to the closest position of their servo"""
+        values = _floats(angles, len(angles))
+        _lib.widowx_quantize(self._handle, values, len(angles))
+        return tuple(values)
+
+    def set_calibration(self, idx, offset, scale):
+        """Offset [rad] and scale of the servo at idx, as setCalibration"""
+        _lib.widowx_set_calibration(self._handle, idx, offset, scale)
+
+    def ik_gamma_batch(self, targets, angles=None, status=None):
+        """
+        Solves every row (x, y, z, gamma) of targets. Returns the angles (rows of Q1 to Q4,
+        NaN without solution), the status of every row (0 solved, 1 no solution) and how
+        many rows were solved. angles and status may be given to reuse their memory
+        """
+        targets = _as_float32(targets)
+        count = _rows(targets, 'targets')
+        if angles is None:
+            angles = numpy.empty((count, 4), numpy.float32) if numpy is not None else bytearray(16 * count)
+        if status is None:
+            status = numpy.empty(count, numpy.uint8) if numpy is not None else bytearray(count)
+        solved = _lib.widowx_ik_gamma_batch(self._handle, _pointer(targets, ctypes.c_float, 4 * count, 'targets'),
+                                            count, _pointer(angles, ctypes.c_float, 4 * count, 'angles'),
+                                            _pointer(status, ctypes.c_uint8, count, 'status'))
+        return angles, status, solved
+
+    def fk_batch(self, angles, poses=None):
+        """Point and gamma of every row (Q1 to Q4) of angles. poses may be given to reuse it"""
+        angles = _as_float32(angles)
+        count = _rows(angles, 'angles')
+        if poses is None:
+            poses = numpy.empty((count, 4), numpy.float32) if numpy is not None else bytearray(16 * count)
+        _lib.widowx_fk_batch(self._handle, _pointer(angles, ctypes.c_float, 4 * count, 'angles'), count,
+                             _pointer(poses, ctypes.c_float, 4 * count, 'poses'))
+        return poses
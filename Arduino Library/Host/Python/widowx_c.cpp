@@ -0,0 +1,110 @@
+/*
+widowx_c.cpp - C interface to the kinematics of the WidowX library, for bindings to other languages
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include "WidowX.h"
+#include "widowx_c.h"
+
+void *widowx_new()
+{
+    return new WidowX();
+}
+
+void widowx_free(void *handle)
+{
+    delete (WidowX *)handle;
+}
+
+int widowx_ik_gamma(void *handle, float x, float y, float z, float gamma, float *angles)
+{
+    return ((WidowX *)handle)->solveIK_Gamma(x, y, z, gamma, angles);
+}
+
+//Rd is a 3x3 matrix by rows, as seen from {1}
+int widowx_ik_rd(void *handle, float x, float y, float z, const float *Rd, float *angles)
+{
+    Matrix<3, 3> R;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            R(i, j) = Rd[3 * i + j];
+    return ((WidowX *)handle)->solveIK_Rd(x, y, z, R, angles);
+}
+
+void widowx_fk(void *handle, const float *angles, float *pose)
+{
+    ((WidowX *)handle)->solveFK(angles, pose);
+}
+
+//R gets the rotation as seen from the base, by rows
+void widowx_pose(void *handle, const float *angles, float *point, float *R)
+{
+    Matrix<3, 3> rotation;
+    ((WidowX *)handle)->solvePose(angles, point, rotation);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            R[3 * i + j] = rotation(i, j);
+}
+
+int widowx_ik_branch(void *handle)
+{
+    return ((WidowX *)handle)->getIKBranch();
+}
+
+float widowx_limit_margin(void *handle, const float *angles)
+{
+    return ((WidowX *)handle)->getLimitMargin(angles);
+}
+
+void widowx_quantize(void *handle, float *angles, int count)
+{
+    ((WidowX *)handle)->quantizeAngles(angles, count);
+}
+
+void widowx_set_calibration(void *handle, int idx, float offset, float scale)
+{
+    ((WidowX *)handle)->setCalibration(idx, offset, scale);
+}
+
+size_t widowx_ik_gamma_batch(void *handle, const float *targets, size_t count, float *angles, uint8_t *status)
+{
+    WidowX *widow = (WidowX *)handle;
+    size_t solved = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const float *t = targets + 4 * i;
+        status[i] = widow->solveIK_Gamma(t[0], t[1], t[2], t[3], angles + 4 * i);
+        if (status[i])
+            for (int j = 0; j < 4; j++)
+                angles[4 * i + j] = NAN;
+        solved += !status[i];
+    }
+    return solved;
+}
+
+void widowx_fk_batch(void *handle, const float *angles, size_t count, float *poses)
+{
+    WidowX *widow = (WidowX *)handle;
+    for (size_t i = 0; i < count; i++)
+        widow->solveFK(angles + 4 * i, poses + 4 * i);
+}
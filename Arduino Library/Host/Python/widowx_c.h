@@ -0,0 +1,68 @@
+/*
+widowx_c.h - C interface to the kinematics of the WidowX library, for bindings to other languages
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef WIDOWX_C
+#define WIDOWX_C
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * Every handle is a separate instance of the class, so different handles can be used
+     * from different threads. Angles are in radians and points in cm. Functions that solve 
+     * the IK return 0 on success and 1 when there is no solution
+    */
+    void *widowx_new();
+    void widowx_free(void *handle);
+
+    int widowx_ik_gamma(void *handle, float x, float y, float z, float gamma, float *angles);
+    int widowx_ik_rd(void *handle, float x, float y, float z, const float *Rd, float *angles);
+    void widowx_fk(void *handle, const float *angles, float *pose);
+    void widowx_pose(void *handle, const float *angles, float *point, float *R);
+    int widowx_ik_branch(void *handle);
+    float widowx_limit_margin(void *handle, const float *angles);
+    void widowx_quantize(void *handle, float *angles, int count);
+    void widowx_set_calibration(void *handle, int idx, float offset, float scale);
+
+    /*
+     * Batches work on arrays in place, without copies. targets and poses are count rows of
+     * x, y, z, gamma; angles are count rows of Q1 to Q4. status gets 0 or 1 for every row
+     * (rows without solution get NAN angles) and the functions return how many rows have a
+     * solution
+    */
+    size_t widowx_ik_gamma_batch(void *handle, const float *targets, size_t count, float *angles, uint8_t *status);
+    void widowx_fk_batch(void *handle, const float *angles, size_t count, float *poses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+/*
+roundtrip.cpp - Checks that the IK and the FK of the WidowX agree, and how fast they are
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "WidowX.h"
+
+//Dimensions of the arm [cm], as in the constructor of the class
+const double L0 = 9, L1 = 14, L2 = 5, L3 = 14, L4 = 14;
+
+struct Target
+{
+    float x, y, z, gamma;
+};
+
+/*
+ * Errors of the solved targets. ik is the error of the IK angles, fk the one of the FK of 
+ * the library with those angles, and servo the one after rounding the angles to servo 
+ * positions. Cartesian errors are in cm and gamma errors in radians
+*/
+struct Errors
+{
+    std::vector<double> ik, fk, servo, gamma;
+};
+
+/*
+ * Reference forward kinematics in double precision, computed from the DH parameters and not 
+ * with the code of the library
+*/
+void referenceFK(const float *q, double *p)
+{
+    const double D = sqrt(L1 * L1 + L2 * L2), alpha = atan2(L1, L2);
+    const double phi = D * cos(alpha + q[1]) + L3 * cos((double)q[1] + q[2]) + L4 * cos((double)q[1] + q[2] + q[3]);
+    p[0] = cos((double)q[0]) * phi;
+    p[1] = sin((double)q[0]) * phi;
+    p[2] = L0 + D * sin(alpha + q[1]) + L3 * sin((double)q[1] + q[2]) + L4 * sin((double)q[1] + q[2] + q[3]);
+}
+
+double distance(const double *p, const Target &t)
+{
+    return sqrt(pow(p[0] - t.x, 2) + pow(p[1] - t.y, 2) + pow(p[2] - t.z, 2));
+}
+
+double percentile(std::vector<double> &values, double fraction)
+{
+    if (values.empty())
+        return 0;
+    size_t k = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+void report(const char *name, std::vector<double> &values, const char *units)
+{
+    double worst = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    printf("%-10s p50 %.6f  p95 %.6f  p99 %.6f  max %.6f %s\n", name, percentile(values, 0.5),
+           percentile(values, 0.95), percentile(values, 0.99), worst, units);
+}
+
+/*
+ * Calls per second of a function, run over all the targets as many times as needed to take
+ * at least 0.2 seconds
+*/
+template <class F>
+double throughput(size_t count, F call)
+{
+    typedef std::chrono::steady_clock Clock;
+    size_t calls = 0;
+    Clock::time_point start = Clock::now();
+    double seconds;
+    do
+    {
+        for (size_t i = 0; i < count; i++)
+            call(i);
+        calls += count;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < 0.2);
+    return calls / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_random = 200000;
+    float step = 2;
+    unsigned seed = 1;
+    double max_ik = 0.0001, max_servo = 0.1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-random") && i + 1 < argc)
+            num_random = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-step") && i + 1 < argc)
+            step = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-seed") && i + 1 < argc)
+            seed = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-max-ik") && i + 1 < argc)
+            max_ik = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-max-servo") && i + 1 < argc)
+            max_servo = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-random n] [-step cm] [-seed n] [-max-ik cm] [-max-servo cm]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    //Targets: a grid over the box around the arm, with a few gammas, plus random ones
+    std::vector<Target> targets;
+    const float gammas[] = {-M_PI_2, -M_PI_4, 0, M_PI_4, M_PI_2};
+    if (step > 0)
+        for (float z = -20; z <= 55; z += step)
+            for (float y = -45; y <= 45; y += step)
+                for (float x = -45; x <= 45; x += step)
+                    for (int g = 0; g < 5; g++)
+                    {
+                        Target t = {x, y, z, gammas[g]};
+                        targets.push_back(t);
+                    }
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> xy(-45, 45), z(-20, 55), gamma(-M_PI_2, M_PI_2);
+    for (size_t i = 0; i < num_random; i++)
+    {
+        Target t = {xy(random), xy(random), z(random), gamma(random)};
+        targets.push_back(t);
+    }
+
+    WidowX widow = WidowX();
+    std::vector<Target> solved;
+    std::vector<float> solutions;
+    Errors errors;
+    float angles[4], pose[4];
+    double p[3];
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        const Target &t = targets[i];
+        if (widow.solveIK_Gamma(t.x, t.y, t.z, t.gamma, angles))
+            continue;
+        solved.push_back(t);
+        solutions.insert(solutions.end(), angles, angles + 4);
+
+        referenceFK(angles, p);
+        errors.ik.push_back(distance(p, t));
+        widow.solveFK(angles, pose);
+        errors.fk.push_back(sqrt(pow(pose[0] - p[0], 2) + pow(pose[1] - p[1], 2) + pow(pose[2] - p[2], 2)));
+
+        widow.quantizeAngles(angles, 4);
+        referenceFK(angles, p);
+        errors.servo.push_back(distance(p, t));
+        errors.gamma.push_back(abs(-(double)angles[1] - angles[2] - angles[3] - t.gamma));
+    }
+
+    printf("%zu targets, %zu with solution\n", targets.size(), solved.size());
+    if (solved.empty())
+        return 1;
+    report("IK", errors.ik, "cm");
+    report("FK", errors.fk, "cm");
+    report("Servo", errors.servo, "cm");
+    report("Gamma", errors.gamma, "rad");
+
+    const size_t n = solved.size();
+    volatile float sink = 0;
+    const double ik_rate = throughput(n, [&](size_t i) {
+        widow.solveIK_Gamma(solved[i].x, solved[i].y, solved[i].z, solved[i].gamma, angles);
+        sink = angles[0];
+    });
+    const double fk_rate = throughput(n, [&](size_t i) {
+        widow.solveFK(&solutions[4 * i], pose);
+        sink = pose[0];
+    });
+    const double trip_rate = throughput(n, [&](size_t i) {
+        widow.solveIK_Gamma(solved[i].x, solved[i].y, solved[i].z, solved[i].gamma, angles);
+        widow.quantizeAngles(angles, 4);
+        widow.solveFK(angles, pose);
+        sink = pose[0];
+    });
+    printf("IK %.0f calls/s, FK %.0f calls/s, round trip %.0f calls/s\n", ik_rate, fk_rate, trip_rate);
+
+    //The thresholds make the program fail, so a change that loses accuracy does not go unnoticed
+    const double worst_ik = *std::max_element(errors.ik.begin(), errors.ik.end());
+    const double worst_servo = *std::max_element(errors.servo.begin(), errors.servo.end());
+    int status = 0;
+    if (worst_ik > max_ik)
+    {
+        printf("FAIL: IK error %.6f cm is above %.6f cm\n", worst_ik, max_ik);
+        status = 1;
+    }
+    if (worst_servo > max_servo)
+    {
+        printf("FAIL: servo error %.6f cm is above %.6f cm\n", worst_servo, max_servo);
+        status = 1;
+    }
+    if (!status)
+        printf("PASS\n");
+    return status;
+}
@@ -0,0 +1,315 @@
+/*
+runner.cpp - Runs a script of WidowX calls on the simulated bus and reports its timing and traffic
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include "WidowX.h"
+#include "ax12.h"
+
+#define MAX_LINE 256
+#define MAX_ARGS 8
+#define MAX_MOVES 1024
+
+/*
+ * What one line of the script did. Times are in milliseconds of the virtual clock and peaks
+ * are the highest speed of each joint, in radians per second
+*/
+struct Move
+{
+    int line;
+    char command[MAX_LINE];
+    unsigned long start;
+    unsigned long duration;
+    unsigned long packets;
+    unsigned long bytes_sent;
+    unsigned long bytes_received;
+    int ik_failures;
+    int queue_full;
+    float peak[6];
+};
+
+WidowX widow = WidowX();
+Move moves[MAX_MOVES];
+int num_moves = 0;
+
+//Radians per position of each servo: 360° in 4096 positions for the MX and 300° in 1024 for the AX-12
+const float rad_per_position[6] = {2 * M_PI / 4096, 2 * M_PI / 4096, 2 * M_PI / 4096, 2 * M_PI / 4096,
+                                   300 * M_PI / 180 / 1024, 300 * M_PI / 180 / 1024};
+const int servo_model[6] = {MX28_MODEL, MX64_MODEL, MX64_MODEL, MX28_MODEL, AX12_MODEL, AX12_MODEL};
+
+/*
+ * Splits the line into the name of the command and its numeric arguments. Arguments may be
+ * separated by spaces, tabs or commas. Returns the number of arguments, or -1 if the line is
+ * empty or a comment (#)
+*/
+int parseLine(char *line, char **name, float *args)
+{
+    char *token = strtok(line, " \t\r\n,()");
+    if (token == NULL || token[0] == '#')
+        return -1;
+    *name = token;
+    int n = 0;
+    while ((token = strtok(NULL, " \t\r\n,()")) != NULL && n < MAX_ARGS)
+        args[n++] = atof(token);
+    return n;
+}
+
+/*
+ * Executes a command. Returns 0 if it worked, 1 if there was no solution for the IK, 2 if the
+ * motion queue was full and -1 if the command or its number of arguments is unknown. The moves
+ * of the queue without IK solution are counted apart, with getDroppedMoves()
+*/
+int execute(const char *name, const float *a, int n)
+{
+    Matrix<3, 3> Rx, Ry, Rz, Rd;
+
+    if (!strcmp(name, "moveCenter") && n == 0)
+        widow.moveCenter();
+    else if (!strcmp(name, "moveHome") && n == 0)
+        widow.moveHome();
+    else if (!strcmp(name, "moveRest") && n == 0)
+        widow.moveRest();
+    else if (!strcmp(name, "moveServo2Angle") && n == 2)
+        widow.moveServo2Angle(a[0], a[1]);
+    else if (!strcmp(name, "moveServo2Position") && n == 2)
+        widow.moveServo2Position(a[0], a[1]);
+    else if (!strcmp(name, "moveGrip") && n == 1)
+        widow.moveGrip(a[0]);
+    else if (!strcmp(name, "moveArmQ4") && n == 3)
+        return widow.moveArmQ4(a[0], a[1], a[2]);
+    else if (!strcmp(name, "moveArmQ4") && n == 4)
+        return widow.moveArmQ4(a[0], a[1], a[2], a[3]);
+    else if (!strcmp(name, "moveArmGamma") && n == 4)
+        return widow.moveArmGamma(a[0], a[1], a[2], a[3]);
+    else if (!strcmp(name, "moveArmGamma") && n == 5)
+        return widow.moveArmGamma(a[0], a[1], a[2], a[3], a[4]);
+    else if (!strcmp(name, "moveArmRdBase") && (n == 6 || n == 7))
+    {
+        //The rotation is given as angles around x, y and z of the base: Rd = Rz*Ry*Rx
+        widow.rotx(a[3], Rx);
+        widow.roty(a[4], Ry);
+        widow.rotz(a[5], Rz);
+        Rd = Rz * Ry * Rx;
+        if (n == 6)
+            return widow.moveArmRdBase(a[0], a[1], a[2], Rd);
+        return widow.moveArmRdBase(a[0], a[1], a[2], Rd, a[6]);
+    }
+    else if (!strcmp(name, "queueArmGamma") && n == 6)
+        return widow.queueArmGamma(a[0], a[1], a[2], a[3], a[4], a[5]) ? 2 : 0;
+    else if (!strcmp(name, "runQueue") && n == 0)
+        widow.runQueue();
+    else if (!strcmp(name, "relaxServos") && n == 0)
+        widow.relaxServos();
+    else if (!strcmp(name, "torqueServos") && n == 0)
+        widow.torqueServos();
+    else if (!strcmp(name, "waitForArrival") && n == 2)
+        widow.waitForArrival(a[0], a[1]);
+    else if (!strcmp(name, "delay") && n == 1)
+        clockDelay(a[0]);
+    else if (!strcmp(name, "setTrajectoryProfile") && n == 1)
+        widow.setTrajectoryProfile(a[0]);
+    else if (!strcmp(name, "setInputShaper") && n == 3)
+        widow.setInputShaper(a[0], a[1], a[2]);
+    else if (!strcmp(name, "setGovernor") && n == 1)
+        widow.setGovernor(a[0]);
+    else if (!strcmp(name, "setVelocityFeedforward") && n == 1)
+        widow.setVelocityFeedforward(a[0]);
+    else if (!strcmp(name, "setDeadband") && n == 1)
+        widow.setDeadband((uint8_t)a[0]);
+    else if (!strcmp(name, "setControlPeriod") && n == 1)
+        widow.setControlPeriod(a[0]);
+    else if (!strcmp(name, "setArrivalTolerance") && n == 2)
+        widow.setArrivalTolerance(a[0], a[1]);
+    else if (!strcmp(name, "setGravityCompensation") && n == 2)
+        widow.setGravityCompensation(a[0], a[1]);
+    else if (!strcmp(name, "setPayload") && n == 1)
+        widow.setPayload(a[0]);
+    else
+        return -1;
+    return 0;
+}
+
+void writeCSV(FILE *out, const Move &total)
+{
+    fprintf(out, "line,command,start_ms,duration_ms,packets,bytes_sent,bytes_received,ik_failure,queue_full");
+    for (int i = 0; i < 6; i++)
+        fprintf(out, ",q%d_peak", i + 1);
+    fprintf(out, "\n");
+    for (int m = 0; m <= num_moves; m++)
+    {
+        const Move &move = m < num_moves ? moves[m] : total;
+        fprintf(out, "%d,\"%s\",%lu,%lu,%lu,%lu,%lu,%d,%d", move.line, move.command, move.start, move.duration,
+                move.packets, move.bytes_sent, move.bytes_received, move.ik_failures, move.queue_full);
+        for (int i = 0; i < 6; i++)
+            fprintf(out, ",%.3f", move.peak[i]);
+        fprintf(out, "\n");
+    }
+}
+
+void writeJSONMove(FILE *out, const Move &move)
+{
+    fprintf(out, "{\"line\": %d, \"command\": \"%s\", \"start_ms\": %lu, \"duration_ms\": %lu, \"packets\": %lu, "
+                 "\"bytes_sent\": %lu, \"bytes_received\": %lu, \"ik_failures\": %d, \"queue_full\": %d, "
+                 "\"peak_rad_s\": [",
+            move.line, move.command, move.start, move.duration, move.packets, move.bytes_sent,
+            move.bytes_received, move.ik_failures, move.queue_full);
+    for (int i = 0; i < 6; i++)
+        fprintf(out, i ? ", %.3f" : "%.3f", move.peak[i]);
+    fprintf(out, "]}");
+}
+
+void writeJSON(FILE *out, const Move &total)
+{
+    fprintf(out, "{\n  \"moves\": [\n");
+    for (int m = 0; m < num_moves; m++)
+    {
+        fprintf(out, "    ");
+        writeJSONMove(out, moves[m]);
+        fprintf(out, m < num_moves - 1 ? ",\n" : "\n");
+    }
+    fprintf(out, "  ],\n  \"total\": ");
+    writeJSONMove(out, total);
+    fprintf(out, "\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *script_name = NULL, *report_name = NULL;
+    uint8_t json = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-json"))
+            json = 1;
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            report_name = argv[++i];
+        else
+            script_name = argv[i];
+    }
+    if (script_name == NULL)
+    {
+        fprintf(stderr, "Usage: %s [-json] [-o report] script\n", argv[0]);
+        return 2;
+    }
+    FILE *script = fopen(script_name, "r");
+    if (script == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", script_name);
+        return 2;
+    }
+
+    //The messages of the library go to stderr, so the report can go to stdout
+    Serial.setOutput(stderr);
+    setVirtualClock(1);
+    for (int i = 0; i < 6; i++)
+    {
+        unsigned char *t = ax12Servo(widow.getId(i));
+        t[AX_MODEL_NUMBER_L] = servo_model[i] & 0xFF;
+        t[AX_MODEL_NUMBER_H] = servo_model[i] >> 8;
+    }
+    ax12SetClock(clockMicros);
+    widow.init(0);
+
+    Move total;
+    memset(&total, 0, sizeof(total));
+    strcpy(total.command, "total");
+    total.start = clockMillis();
+
+    char line[MAX_LINE], text[MAX_LINE];
+    float args[MAX_ARGS];
+    char *name;
+    int line_number = 0, status = 0;
+    while (fgets(line, MAX_LINE, script) != NULL)
+    {
+        line_number++;
+        strcpy(text, line);
+        text[strcspn(text, "\r\n")] = 0;
+        int n = parseLine(line, &name, args);
+        if (n < 0)
+            continue;
+        if (num_moves == MAX_MOVES)
+        {
+            fprintf(stderr, "%s:%d: more than %d commands\n", script_name, line_number, MAX_MOVES);
+            status = 1;
+            break;
+        }
+
+        Move &move = moves[num_moves];
+        move.line = line_number;
+        strcpy(move.command, text + strspn(text, " \t"));
+        for (char *c = move.command; *c; c++)
+            if (*c == '"' || *c == '\\')
+                *c = '\'';
+        ax12ResetStats();
+        ax12ResetPeaks();
+        move.start = clockMillis() - total.start;
+
+        const unsigned long dropped = widow.getDroppedMoves();
+        int result = execute(name, args, n);
+        if (result < 0)
+        {
+            fprintf(stderr, "%s:%d: unknown command \"%s\" with %d arguments\n", script_name, line_number, name, n);
+            status = 1;
+            continue;
+        }
+        if (result == 2)
+        {
+            fprintf(stderr, "%s:%d: the motion queue is full (%d moves)\n", script_name, line_number, QUEUE_SIZE);
+            status = 1;
+        }
+
+        move.duration = clockMillis() - total.start - move.start;
+        move.packets = ax12PacketsSent();
+        move.bytes_sent = ax12BytesSent();
+        move.bytes_received = ax12BytesReceived();
+        move.ik_failures = (result == 1) + (widow.getDroppedMoves() - dropped);
+        move.queue_full = result == 2;
+        for (int i = 0; i < 6; i++)
+            move.peak[i] = ax12PeakSpeed(widow.getId(i)) * rad_per_position[i];
+
+        total.duration += move.duration;
+        total.packets += move.packets;
+        total.bytes_sent += move.bytes_sent;
+        total.bytes_received += move.bytes_received;
+        total.ik_failures += move.ik_failures;
+        total.queue_full += move.queue_full;
+        for (int i = 0; i < 6; i++)
+            total.peak[i] = max(total.peak[i], move.peak[i]);
+        num_moves++;
+    }
+    fclose(script);
+    total.start = 0;
+
+    FILE *report = report_name ? fopen(report_name, "w") : stdout;
+    if (report == NULL)
+    {
+        fprintf(stderr, "Cannot write %s\n", report_name);
+        return 2;
+    }
+    if (json)
+        writeJSON(report, total);
+    else
+        writeCSV(report, total);
+    if (report != stdout)
+        fclose(report);
+    return status;
+}
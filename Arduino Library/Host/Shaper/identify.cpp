@@ -0,0 +1,198 @@
+/*
+identify.cpp - Estimates the dominant vibration mode of a WidowX from a logged response
+
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct Peak
+{
+    double time;
+    double amplitude;
+};
+
+/*
+ * Fits y = a + b * x by least squares and returns b
+*/
+double slope(const std::vector<double> &x, const std::vector<double> &y)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    const size_t n = x.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+/*
+ * Finds the peak of every half cycle of the residual e around the final value: a half cycle
+ * ends when e goes beyond threshold with the other sign. The time of each peak is refined
+ * with a parabola through the samples around it
+*/
+std::vector<Peak> findPeaks(const std::vector<double> &t, const std::vector<double> &e, double threshold)
+{
+    std::vector<Peak> peaks;
+    int sign = 0;
+    size_t best = 0;
+    for (size_t i = 0; i <= e.size(); i++)
+    {
+        const int s = i == e.size() ? -sign : (e[i] > threshold ? 1 : (e[i] < -threshold ? -1 : 0));
+        if (s != 0 && s != sign)
+        {
+            if (sign != 0)
+            {
+                Peak peak = {t[best], fabs(e[best])};
+                if (best > 0 && best + 1 < e.size())
+                {
+                    const double denominator = e[best - 1] - 2 * e[best] + e[best + 1];
+                    if (denominator != 0)
+                        peak.time += 0.5 * (e[best - 1] - e[best + 1]) / denominator * (t[best + 1] - t[best - 1]) / 2;
+                }
+                peaks.push_back(peak);
+            }
+            sign = s;
+            best = i;
+        }
+        else if (i < e.size() && sign != 0 && e[i] * sign > e[best] * sign)
+            best = i;
+    }
+    return peaks;
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = NULL;
+    double from = 0;
+    int column = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-from") && i + 1 < argc)
+            from = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-col") && i + 1 < argc)
+            column = atoi(argv[++i]);
+        else
+            name = argv[i];
+    }
+    if (name == NULL || column < 1)
+    {
+        fprintf(stderr, "Usage: %s [-from ms] [-col n] log.csv\n", argv[0]);
+        return 2;
+    }
+    FILE *file = fopen(name, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", name);
+        return 2;
+    }
+
+    //Every line: time in milliseconds and one or more values; column n is the value used
+    std::vector<double> t, x;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (line[0] == '#')
+            continue;
+        char *p = line, *end;
+        const double time = strtod(p, &end);
+        if (end == p)
+            continue;
+        double value = 0;
+        int found = 0;
+        for (int c = 1; c <= column; c++)
+        {
+            p = end;
+            while (*p == ',' || *p == ' ' || *p == '\t')
+                p++;
+            value = strtod(p, &end);
+            found = end != p;
+            if (!found)
+                break;
+        }
+        if (found && time >= from)
+        {
+            t.push_back(time);
+            x.push_back(value);
+        }
+    }
+    fclose(file);
+    if (t.size() < 10)
+    {
+        fprintf(stderr, "%s: at least 10 samples after %.0f ms are needed\n", name, from);
+        return 2;
+    }
+
+    //The last fifth of the log gives the final value and the noise
+    const size_t tail = t.size() / 5;
+    double final_value = 0, noise = 0;
+    for (size_t i = t.size() - tail; i < t.size(); i++)
+        final_value += x[i] / tail;
+    for (size_t i = t.size() - tail; i < t.size(); i++)
+        noise += pow(x[i] - final_value, 2) / tail;
+    //Positions are integers, so the noise is at least half a position
+    const double threshold = 3 * fmax(sqrt(noise), 0.5);
+
+    std::vector<double> e(x.size());
+    for (size_t i = 0; i < x.size(); i++)
+        e[i] = x[i] - final_value;
+    const std::vector<Peak> peaks = findPeaks(t, e, threshold);
+    if (peaks.size() < 3)
+    {
+        fprintf(stderr, "%s: only %zu half cycles above the noise (%.2f); at least 3 are needed\n", name, peaks.size(), threshold);
+        return 1;
+    }
+
+    //Peaks are half a damped period apart and decay as exp(-sigma * t). The noise makes the 
+    //small peaks look larger, so the decay is fitted with the ones well above it
+    std::vector<double> index, times, large_times, logs;
+    for (size_t k = 0; k < peaks.size(); k++)
+    {
+        index.push_back(k);
+        times.push_back(peaks[k].time / 1000);
+        if (peaks[k].amplitude > 3 * threshold || large_times.size() < 3)
+        {
+            large_times.push_back(peaks[k].time / 1000);
+            logs.push_back(log(peaks[k].amplitude));
+        }
+    }
+    const double damped_period = 2 * slope(index, times);
+    const double sigma = -slope(large_times, logs);
+    const double wd = 2 * M_PI / damped_period;
+    const double wn = sqrt(sigma * sigma + wd * wd);
+    const double frequency = wn / (2 * M_PI);
+    const double damping = fmax(sigma, 0) / wn;
+
+    printf("//Dominant mode from %s: %.3f Hz, damping ratio %.4f (%zu half cycles, final value %.2f)\n",
+           name, frequency, damping, peaks.size(), final_value);
+    printf("//ZVD adds %.0f ms to every move; ZV adds %.0f ms but is more sensitive to errors in the frequency\n",
+           damped_period * 1000, damped_period * 500);
+    printf("widow.setInputShaper(SHAPER_ZVD, %.3f, %.4f);\n", frequency, damping);
+    return 0;
+}
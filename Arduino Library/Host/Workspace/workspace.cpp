@@ -0,0 +1,272 @@
+/*
+workspace.cpp - Builds a map of where the WidowX can reach, with which elbow and how far from its limits
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include "WidowX.h"
+
+#define VOLUME_VERSION 1
+#define CHUNK_CELLS 256
+#define UNREACHABLE 0xFF
+
+/*
+ * One cell of the volume. reach is how many of the gamma samples have a solution, branches 
+ * has bit 0 set if the first elbow solution was used and bit 1 if the second one was, margin 
+ * is the largest distance to the joint limits among the solutions in degrees, and best_gamma 
+ * is the index of the gamma sample with that margin (UNREACHABLE if there is none)
+*/
+struct Cell
+{
+    uint8_t reach;
+    uint8_t branches;
+    uint8_t margin;
+    uint8_t best_gamma;
+};
+
+struct Volume
+{
+    int nx, ny, nz;
+    float x0, y0, z0, step;
+    float gamma_min, gamma_max;
+    int num_gamma;
+    std::vector<Cell> cells;
+};
+
+/*
+ * Range of cells to solve. Each worker takes chunks from the back of its own queue; when it
+ * runs out, it steals from the front of the queue of another worker, so the cells near the 
+ * border of the workspace, which take longer, do not leave cores idle
+*/
+struct Chunk
+{
+    size_t begin, end;
+};
+
+struct Worker
+{
+    std::deque<Chunk> chunks;
+    std::mutex lock;
+    unsigned long cells, stolen;
+};
+
+std::vector<Worker> workers;
+
+uint8_t takeChunk(int w, Chunk *chunk)
+{
+    {
+        std::lock_guard<std::mutex> guard(workers[w].lock);
+        if (!workers[w].chunks.empty())
+        {
+            *chunk = workers[w].chunks.back();
+            workers[w].chunks.pop_back();
+            return 1;
+        }
+    }
+    for (size_t k = 1; k < workers.size(); k++)
+    {
+        Worker &victim = workers[(w + k) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.chunks.empty())
+        {
+            *chunk = victim.chunks.front();
+            victim.chunks.pop_front();
+            workers[w].stolen++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void solveCell(WidowX &widow, Volume &volume, size_t index)
+{
+    const int i = index % volume.nx;
+    const int j = (index / volume.nx) % volume.ny;
+    const int k = index / ((size_t)volume.nx * volume.ny);
+    const float x = volume.x0 + i * volume.step;
+    const float y = volume.y0 + j * volume.step;
+    const float z = volume.z0 + k * volume.step;
+    const float gamma_step = volume.num_gamma > 1 ? (volume.gamma_max - volume.gamma_min) / (volume.num_gamma - 1) : 0;
+
+    Cell cell = {0, 0, 0, UNREACHABLE};
+    float angles[4], best = -1;
+    for (int g = 0; g < volume.num_gamma; g++)
+    {
+        if (widow.solveIK_Gamma(x, y, z, volume.gamma_min + g * gamma_step, angles))
+            continue;
+        cell.reach++;
+        cell.branches |= 1 << widow.getIKBranch();
+        const float margin = widow.getLimitMargin(angles);
+        if (margin > best)
+        {
+            best = margin;
+            cell.best_gamma = g;
+        }
+    }
+    if (cell.reach)
+        cell.margin = min(255.0f, best * 180 / M_PI + 0.5f);
+    volume.cells[index] = cell;
+}
+
+void work(int w, Volume *volume)
+{
+    //Every thread has its own instance: the IK only uses the members of the class
+    WidowX widow = WidowX();
+    Chunk chunk;
+    while (takeChunk(w, &chunk))
+    {
+        for (size_t index = chunk.begin; index < chunk.end; index++)
+            solveCell(widow, *volume, index);
+        workers[w].cells += chunk.end - chunk.begin;
+    }
+}
+
+/*
+ * Volume file: "WXWS", version, size of a cell (uint16), nx, ny, nz (int32), x0, y0, z0, 
+ * step, gamma_min, gamma_max (float32), number of gamma samples (int32) and then the cells, 
+ * with x changing fastest and z slowest. Everything is little endian
+*/
+uint8_t writeVolume(const char *name, const Volume &volume)
+{
+    FILE *file = fopen(name, "wb");
+    if (file == NULL)
+        return 1;
+    const uint16_t version = VOLUME_VERSION, cell_size = sizeof(Cell);
+    const int32_t header[] = {volume.nx, volume.ny, volume.nz};
+    const float geometry[] = {volume.x0, volume.y0, volume.z0, volume.step, volume.gamma_min, volume.gamma_max};
+    const int32_t num_gamma = volume.num_gamma;
+    fwrite("WXWS", 1, 4, file);
+    fwrite(&version, sizeof(version), 1, file);
+    fwrite(&cell_size, sizeof(cell_size), 1, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(geometry, sizeof(geometry), 1, file);
+    fwrite(&num_gamma, sizeof(num_gamma), 1, file);
+    size_t written = fwrite(volume.cells.data(), sizeof(Cell), volume.cells.size(), file);
+    fclose(file);
+    return written != volume.cells.size();
+}
+
+int main(int argc, char **argv)
+{
+    Volume volume;
+    float x_max = 45, y_max = 45, z_max = 55;
+    volume.x0 = -45;
+    volume.y0 = -45;
+    volume.z0 = -20;
+    volume.step = 1;
+    volume.gamma_min = -M_PI_2;
+    volume.gamma_max = M_PI_2;
+    volume.num_gamma = 32;
+    int num_threads = std::thread::hardware_concurrency();
+    const char *name = "workspace.wxv";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-step") && i + 1 < argc)
+            volume.step = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-gammas") && i + 1 < argc)
+            volume.num_gamma = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+            num_threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-x") && i + 2 < argc)
+        {
+            volume.x0 = atof(argv[++i]);
+            x_max = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-y") && i + 2 < argc)
+        {
+            volume.y0 = atof(argv[++i]);
+            y_max = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-z") && i + 2 < argc)
+        {
+            volume.z0 = atof(argv[++i]);
+            z_max = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            name = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-step cm] [-gammas n] [-threads n] [-x min max] [-y min max] [-z min max] [-o file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (volume.step <= 0 || volume.num_gamma < 1 || volume.num_gamma > 255)
+    {
+        fprintf(stderr, "The step must be positive and the gamma samples between 1 and 255\n");
+        return 2;
+    }
+    if (num_threads < 1)
+        num_threads = 1;
+
+    volume.nx = (int)((x_max - volume.x0) / volume.step) + 1;
+    volume.ny = (int)((y_max - volume.y0) / volume.step) + 1;
+    volume.nz = (int)((z_max - volume.z0) / volume.step) + 1;
+    const size_t num_cells = (size_t)volume.nx * volume.ny * volume.nz;
+    volume.cells.resize(num_cells);
+
+    //Chunks are dealt round robin, so every worker starts with cells from the whole volume
+    workers = std::vector<Worker>(num_threads);
+    for (size_t begin = 0, n = 0; begin < num_cells; begin += CHUNK_CELLS, n++)
+    {
+        Chunk chunk = {begin, min(begin + CHUNK_CELLS, num_cells)};
+        workers[n % num_threads].chunks.push_back(chunk);
+    }
+    for (int w = 0; w < num_threads; w++)
+        workers[w].cells = workers[w].stolen = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int w = 0; w < num_threads; w++)
+        threads.push_back(std::thread(work, w, &volume));
+    for (size_t w = 0; w < threads.size(); w++)
+        threads[w].join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t reachable = 0, both = 0, solved = 0;
+    for (size_t i = 0; i < num_cells; i++)
+    {
+        solved += volume.cells[i].reach;
+        reachable += volume.cells[i].reach > 0;
+        both += volume.cells[i].branches == 3;
+    }
+    const double samples = (double)num_cells * volume.num_gamma;
+    printf("%dx%dx%d cells, %d gamma samples: %.0f samples (%zu solved) in %.2f s (%.0f per second) with %d threads\n",
+           volume.nx, volume.ny, volume.nz, volume.num_gamma, samples, solved, seconds, samples / seconds, num_threads);
+    printf("Reachable cells: %zu (%.1f%%), with both elbow solutions: %zu\n", reachable, 100.0 * reachable / num_cells, both);
+    for (int w = 0; w < num_threads; w++)
+        printf("Thread %d: %lu cells, %lu chunks stolen\n", w, workers[w].cells, workers[w].stolen);
+
+    if (writeVolume(name, volume))
+    {
+        fprintf(stderr, "Cannot write %s\n", name);
+        return 1;
+    }
+    printf("Volume written to %s\n", name);
+    return 0;
+}
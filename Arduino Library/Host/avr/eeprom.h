@@ -0,0 +1,20 @@
+/*
+eeprom.h - Host (Linux) replacement of avr/eeprom.h. The EEPROM is a block of memory that 
+starts erased (0xFF) every time the program runs
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x7FF
+
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+void eeprom_write_block(const void *src, void *dst, size_t n);
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+
+#endif
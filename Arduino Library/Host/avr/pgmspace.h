@@ -0,0 +1,14 @@
+/*
+pgmspace.h - Host (Linux) replacement of avr/pgmspace.h. Program memory is ordinary memory
+ */
+
+#ifndef PGMSPACE
+#define PGMSPACE
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte_near(address) (*(const uint8_t *)(address))
+#define pgm_read_word_near(address) (*(const uint16_t *)(address))
+
+#endif
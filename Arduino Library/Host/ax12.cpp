@@ -0,0 +1,342 @@
+/*
+ax12.cpp - Host (Linux) replacement of the Bioloid ax12 library: a simulated Dynamixel bus
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include "ax12.h"
+
+unsigned char ax_rx_buffer[AX12_BUFFER_SIZE];
+unsigned char ax_tx_buffer[AX12_BUFFER_SIZE];
+
+unsigned char servo_table[AX12_MAX_SERVOS][AX_CONTROL_TABLE_SIZE];
+uint8_t servo_ready = 0;
+
+//Bytes of the packet being transmitted. A sync write of six servos is 4 + 6*5 + 4 bytes long
+unsigned char tx_packet[256];
+int tx_length = 0;
+int rx_length = 0;
+
+//Motion model. Without a clock, servos reach their goals at once
+unsigned long (*servo_clock)() = NULL;
+unsigned long servo_stamp = 0;
+float servo_position[AX12_MAX_SERVOS];
+float servo_peak[AX12_MAX_SERVOS];
+
+unsigned long packets_sent = 0;
+unsigned long bytes_sent = 0;
+unsigned long bytes_received = 0;
+
+void resetServos()
+{
+    memset(servo_table, 0, sizeof(servo_table));
+    for (int id = 0; id < AX12_MAX_SERVOS; id++)
+    {
+        unsigned char *t = servo_table[id];
+        t[AX_MODEL_NUMBER_L] = MX28_MODEL & 0xFF;
+        t[AX_MODEL_NUMBER_H] = MX28_MODEL >> 8;
+        t[AX_ID] = id;
+        t[AX_RETURN_LEVEL] = 2;
+        t[AX_GOAL_POSITION_L] = t[AX_PRESENT_POSITION_L] = 0x00;
+        t[AX_GOAL_POSITION_H] = t[AX_PRESENT_POSITION_H] = 0x08;
+        t[AX_TORQUE_LIMIT_L] = t[AX_MAX_TORQUE_L] = 0xFF;
+        t[AX_TORQUE_LIMIT_H] = t[AX_MAX_TORQUE_H] = 0x03;
+        t[AX_PRESENT_VOLTAGE] = 120;
+        t[AX_PRESENT_TEMPERATURE] = 25;
+        t[AX_PUNCH_L] = 32;
+        servo_position[id] = 2048;
+        servo_peak[id] = 0;
+    }
+    servo_ready = 1;
+}
+
+int readWord(const unsigned char *t, int reg)
+{
+    return t[reg] + (t[reg + 1] << 8);
+}
+
+/*
+ * Speed of the servo in positions per second. A goal speed of 0 is the maximum speed of
+ * the model at 12V: 114rpm for the AX-12, 55rpm for the MX-28 and 63rpm for the MX-64
+*/
+float servoSpeed(const unsigned char *t)
+{
+    int model = readWord(t, AX_MODEL_NUMBER_L);
+    int goal_speed = readWord(t, AX_GOAL_SPEED_L) & 0x3FF;
+    float rpm, positions;
+    if (model == AX12_MODEL)
+    {
+        rpm = goal_speed ? goal_speed * 0.111 : 114;
+        positions = 1024 * 360.0 / 300;
+    }
+    else
+    {
+        rpm = goal_speed ? goal_speed * 0.114 : (model == MX64_MODEL ? 63 : 55);
+        positions = 4096;
+    }
+    return rpm * positions / 60;
+}
+
+/*
+ * Moves every servo with torque towards its goal, at its speed, for the time elapsed since 
+ * the last bus operation. Goals only change with packets, so this is exact
+*/
+void advanceServos()
+{
+    if (servo_clock == NULL)
+        return;
+    unsigned long now = servo_clock();
+    float dt = (now - servo_stamp) / 1000000.0;
+    servo_stamp = now;
+    if (dt <= 0)
+        return;
+    for (int id = 0; id < AX12_MAX_SERVOS; id++)
+    {
+        unsigned char *t = servo_table[id];
+        float error = readWord(t, AX_GOAL_POSITION_L) - servo_position[id];
+        float step = servoSpeed(t) * dt;
+        if (!t[AX_TORQUE_ENABLE] || error == 0)
+        {
+            t[AX_MOVING] = 0;
+            continue;
+        }
+        if (abs(error) <= step)
+            step = abs(error);
+        servo_position[id] += error > 0 ? step : -step;
+        if (step / dt > servo_peak[id])
+            servo_peak[id] = step / dt;
+        int position = (int)(servo_position[id] + 0.5);
+        t[AX_PRESENT_POSITION_L] = position & 0xFF;
+        t[AX_PRESENT_POSITION_H] = position >> 8;
+        t[AX_MOVING] = servo_position[id] != readWord(t, AX_GOAL_POSITION_L);
+    }
+}
+
+unsigned char *ax12Servo(int id)
+{
+    if (!servo_ready)
+        resetServos();
+    if (id < 0 || id >= AX12_MAX_SERVOS)
+        return NULL;
+    return servo_table[id];
+}
+
+/*
+ * Writes data into the control table of a servo. Without a clock the servos move instantly,
+ * so a new goal position is also the present position
+*/
+void writeTable(int id, int reg, const unsigned char *data, int length)
+{
+    unsigned char *t = ax12Servo(id);
+    if (t == NULL)
+        return;
+    for (int i = 0; i < length && reg + i < AX_CONTROL_TABLE_SIZE; i++)
+        t[reg + i] = data[i];
+    if (reg > AX_GOAL_POSITION_H || reg + length <= AX_GOAL_POSITION_L)
+        return;
+    //As the real servo, a new goal turns the torque on
+    t[AX_TORQUE_ENABLE] = 1;
+    if (servo_clock == NULL)
+    {
+        servo_position[id] = readWord(t, AX_GOAL_POSITION_L);
+        t[AX_PRESENT_POSITION_L] = t[AX_GOAL_POSITION_L];
+        t[AX_PRESENT_POSITION_H] = t[AX_GOAL_POSITION_H];
+    }
+}
+
+/*
+ * Decodes the packet in tx_packet: 0xFF 0xFF id length instruction params... checksum. 
+ * A read leaves the status packet in ax_rx_buffer, as the real servo would answer it
+*/
+void executePacket()
+{
+    rx_length = 0;
+    if (tx_length == 0)
+        return;
+    packets_sent++;
+    bytes_sent += tx_length;
+    if (tx_length < 6 || tx_packet[0] != 0xFF || tx_packet[1] != 0xFF)
+        return;
+    int id = tx_packet[2];
+    int length = tx_packet[3];
+    int instruction = tx_packet[4];
+    unsigned char *params = tx_packet + 5;
+    int numParams = length - 2;
+    if (tx_length < length + 4)
+        return;
+    advanceServos();
+
+    if (instruction == AX_WRITE_DATA && numParams > 1)
+        writeTable(id, params[0], params + 1, numParams - 1);
+    else if (instruction == AX_SYNC_WRITE && numParams > 2)
+    {
+        int reg = params[0], size = params[1];
+        for (int p = 2; p + size < numParams; p += size + 1)
+            writeTable(params[p], reg, params + p + 1, size);
+    }
+    else if (instruction == AX_READ_DATA && numParams == 2)
+    {
+        unsigned char *t = ax12Servo(id);
+        if (t == NULL)
+            return;
+        int reg = params[0], size = params[1];
+        unsigned char checksum = id + size + 2;
+        ax_rx_buffer[0] = ax_rx_buffer[1] = 0xFF;
+        ax_rx_buffer[2] = id;
+        ax_rx_buffer[3] = size + 2;
+        ax_rx_buffer[4] = 0;
+        for (int i = 0; i < size && 6 + i < AX12_BUFFER_SIZE; i++)
+        {
+            ax_rx_buffer[5 + i] = reg + i < AX_CONTROL_TABLE_SIZE ? t[reg + i] : 0;
+            checksum += ax_rx_buffer[5 + i];
+        }
+        ax_rx_buffer[5 + size] = ~checksum;
+        rx_length = size + 6;
+    }
+
+    //Status packet of the servo: only reads are answered with return level 1
+    unsigned char *t = ax12Servo(id);
+    if (t != NULL && (t[AX_RETURN_LEVEL] == 2 || (t[AX_RETURN_LEVEL] == 1 && instruction == AX_READ_DATA)))
+        bytes_received += instruction == AX_READ_DATA ? rx_length : 6;
+}
+
+void ax12SetClock(unsigned long (*clock)())
+{
+    ax12Servo(0);
+    servo_clock = clock;
+    if (clock != NULL)
+        servo_stamp = clock();
+}
+
+float ax12PeakSpeed(int id)
+{
+    if (id < 0 || id >= AX12_MAX_SERVOS)
+        return 0;
+    return servo_peak[id];
+}
+
+void ax12ResetPeaks()
+{
+    for (int id = 0; id < AX12_MAX_SERVOS; id++)
+        servo_peak[id] = 0;
+}
+
+unsigned long ax12PacketsSent()
+{
+    return packets_sent;
+}
+
+unsigned long ax12BytesSent()
+{
+    return bytes_sent;
+}
+
+unsigned long ax12BytesReceived()
+{
+    return bytes_received;
+}
+
+void ax12ResetStats()
+{
+    packets_sent = bytes_sent = bytes_received = 0;
+}
+
+void ax12Init(long baud)
+{
+    resetServos();
+}
+
+void setTXall()
+{
+    tx_length = 0;
+}
+
+void setTX(int id)
+{
+    tx_length = 0;
+}
+
+//The direction of the bus turns around when the packet is complete
+void setRX(int id)
+{
+    executePacket();
+    tx_length = 0;
+}
+
+void ax12write(unsigned char data)
+{
+    if (tx_length < (int)sizeof(tx_packet))
+        tx_packet[tx_length++] = data;
+}
+
+void ax12writeB(unsigned char data)
+{
+    ax12write(data);
+}
+
+int ax12ReadPacket(int length)
+{
+    return rx_length >= length ? length : rx_length;
+}
+
+void sendPacket(int id, int instruction, const unsigned char *params, int numParams)
+{
+    unsigned char checksum = id + numParams + 2 + instruction;
+    setTX(id);
+    ax12writeB(0xFF);
+    ax12writeB(0xFF);
+    ax12writeB(id);
+    ax12writeB(numParams + 2);
+    ax12writeB(instruction);
+    for (int i = 0; i < numParams; i++)
+    {
+        checksum += params[i];
+        ax12writeB(params[i]);
+    }
+    ax12writeB(~checksum);
+    setRX(id);
+}
+
+int ax12GetRegister(int id, int regstart, int length)
+{
+    unsigned char params[2] = {(unsigned char)regstart, (unsigned char)length};
+    sendPacket(id, AX_READ_DATA, params, 2);
+    if (ax12ReadPacket(length + 6) > 0)
+    {
+        if (length == 1)
+            return ax_rx_buffer[5];
+        return ax_rx_buffer[5] + (ax_rx_buffer[6] << 8);
+    }
+    return -1;
+}
+
+void ax12SetRegister(int id, int regstart, int data)
+{
+    unsigned char params[2] = {(unsigned char)regstart, (unsigned char)(data & 0xFF)};
+    sendPacket(id, AX_WRITE_DATA, params, 2);
+}
+
+void ax12SetRegister2(int id, int regstart, int data)
+{
+    unsigned char params[3] = {(unsigned char)regstart, (unsigned char)(data & 0xFF), (unsigned char)((data & 0xFF00) >> 8)};
+    sendPacket(id, AX_WRITE_DATA, params, 3);
+}
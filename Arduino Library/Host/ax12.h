@@ -0,0 +1,141 @@
+/*
+ax12.h - Host (Linux) replacement of the Bioloid ax12 library: a simulated Dynamixel bus
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef ax12_h
+#define ax12_h
+
+#include "Arduino.h"
+
+#define AX12_MAX_SERVOS 30
+#define AX12_BUFFER_SIZE 32
+
+/** EEPROM AREA **/
+#define AX_MODEL_NUMBER_L 0
+#define AX_MODEL_NUMBER_H 1
+#define AX_VERSION 2
+#define AX_ID 3
+#define AX_BAUD_RATE 4
+#define AX_RETURN_DELAY_TIME 5
+#define AX_CW_ANGLE_LIMIT_L 6
+#define AX_CW_ANGLE_LIMIT_H 7
+#define AX_CCW_ANGLE_LIMIT_L 8
+#define AX_CCW_ANGLE_LIMIT_H 9
+#define AX_LIMIT_TEMPERATURE 11
+#define AX_DOWN_LIMIT_VOLTAGE 12
+#define AX_UP_LIMIT_VOLTAGE 13
+#define AX_MAX_TORQUE_L 14
+#define AX_MAX_TORQUE_H 15
+#define AX_RETURN_LEVEL 16
+#define AX_ALARM_LED 17
+#define AX_ALARM_SHUTDOWN 18
+/** RAM AREA **/
+#define AX_TORQUE_ENABLE 24
+#define AX_LED 25
+#define AX_CW_COMPLIANCE_MARGIN 26
+#define AX_CCW_COMPLIANCE_MARGIN 27
+#define AX_CW_COMPLIANCE_SLOPE 28
+#define AX_CCW_COMPLIANCE_SLOPE 29
+#define AX_GOAL_POSITION_L 30
+#define AX_GOAL_POSITION_H 31
+#define AX_GOAL_SPEED_L 32
+#define AX_GOAL_SPEED_H 33
+#define AX_TORQUE_LIMIT_L 34
+#define AX_TORQUE_LIMIT_H 35
+#define AX_PRESENT_POSITION_L 36
+#define AX_PRESENT_POSITION_H 37
+#define AX_PRESENT_SPEED_L 38
+#define AX_PRESENT_SPEED_H 39
+#define AX_PRESENT_LOAD_L 40
+#define AX_PRESENT_LOAD_H 41
+#define AX_PRESENT_VOLTAGE 42
+#define AX_PRESENT_TEMPERATURE 43
+#define AX_REGISTERED_INSTRUCTION 44
+#define AX_MOVING 46
+#define AX_LOCK 47
+#define AX_PUNCH_L 48
+#define AX_PUNCH_H 49
+/** Instruction Set **/
+#define AX_PING 1
+#define AX_READ_DATA 2
+#define AX_WRITE_DATA 3
+#define AX_REG_WRITE 4
+#define AX_ACTION 5
+#define AX_RESET 6
+#define AX_SYNC_WRITE 131
+
+#define AX_CONTROL_TABLE_SIZE 50
+#define AX12_MODEL 12
+#define MX28_MODEL 29
+#define MX64_MODEL 310
+#define AX_BROADCAST_ID 254
+
+extern unsigned char ax_rx_buffer[AX12_BUFFER_SIZE];
+extern unsigned char ax_tx_buffer[AX12_BUFFER_SIZE];
+
+void ax12Init(long baud);
+void setTXall();
+void setTX(int id);
+void setRX(int id);
+void ax12write(unsigned char data);
+void ax12writeB(unsigned char data);
+int ax12ReadPacket(int length);
+int ax12GetRegister(int id, int regstart, int length);
+void ax12SetRegister(int id, int regstart, int data);
+void ax12SetRegister2(int id, int regstart, int data);
+
+/*
+ * Control table of a simulated servo, so a host program can inspect (or alter) what the 
+ * library wrote. Every servo starts as an MX-28 at the center (2048) with 12.0V and 25°C. 
+ * Without a clock, goals are reached at once: the present position follows the goal position 
+ * as soon as it is written
+*/
+unsigned char *ax12Servo(int id);
+
+/*
+ * Gives the simulated servos a time source in microseconds (for example clockMicros). From
+ * then on they move towards their goal at the goal speed, or at the maximum speed of their 
+ * model when it is 0. NULL goes back to instant moves. ax12PeakSpeed is the highest speed
+ * of a servo, in positions per second, since the last ax12ResetPeaks
+*/
+void ax12SetClock(unsigned long (*clock)());
+float ax12PeakSpeed(int id);
+void ax12ResetPeaks();
+
+/*
+ * Traffic of the simulated bus: instruction packets and their bytes, and the bytes of the
+ * status packets the servos answer according to their return level
+*/
+unsigned long ax12PacketsSent();
+unsigned long ax12BytesSent();
+unsigned long ax12BytesReceived();
+void ax12ResetStats();
+
+#define GetPosition(id) (ax12GetRegister(id, AX_PRESENT_POSITION_L, 2))
+#define SetPosition(id, pos) (ax12SetRegister2(id, AX_GOAL_POSITION_L, pos))
+#define TorqueOn(id) (ax12SetRegister(id, AX_TORQUE_ENABLE, 1))
+#define Relax(id) (ax12SetRegister(id, AX_TORQUE_ENABLE, 0))
+
+#endif
@@ -29,6 +29,9 @@ SOFTWARE.
 #include <ax12.h>
 #include "math.h"
 #include "poses.h"
+#include <avr/eeprom.h>
+#include "profile.h"
+#include "clock.h"
 #include <BasicLinearAlgebra.h>
 
 using namespace BLA;
@@ -37,9 +40,6 @@ using namespace BLA;
 /*
     *** GLOBAL VARIABLES ***
 */
-float phi2;
-float a, b, c, cond;
-float q1, q2, q3, q4, q5, q6;
 int posQ4, posQ5, posQ6;
 const float limPi_2 = 181 * M_PI / 360;
 const float lim5Pi_6 = 5 * M_PI / 6;
@@ -47,8 +47,32 @@ const float q2Lim[] = {-limPi_2, limPi_2};
 const float q3Lim[] = {-limPi_2, lim5Pi_6};
 const float q4Lim[] = {-11 * M_PI / 18, limPi_2};
 long t0;
-int currentTime, remainingTime;
-float curr_2, curr_3;
+int remainingTime;
+
+//Nominal conversion of each servo: radians per position and position of 0 rad
+//MX-28 and MX-64: 0 - 4095, 0.088°. AX-12: 0 - 1023, 0.29°. Q2 turns the other way
+const float nominal_gain[] = {0.00153435538637, -0.00153435538637, 0.00153435538637, 0.00153435538637,
+                              0.00511826979472, 0.00511826979472};
+const float nominal_zero[] = {2047.5, 2047.5, 2047.5, 2047.5, 511.5, 511.5};
+
+//Normalized S-curve: peak velocity, acceleration and jerk for a displacement of 1 in a time of 1
+const float sc_vel = 1 / (1 - SC_TA);
+const float sc_acc = sc_vel / (SC_TA - SC_TJ);
+const float sc_jerk = sc_acc / SC_TJ;
+
+//Control tick, shared with the Timer1 interrupt (WIDOWX_TIMER1_TICK)
+volatile uint8_t tick_flag;
+volatile unsigned long tick_count;
+volatile unsigned long tick_stamp;
+
+#if defined(__AVR__) && defined(WIDOWX_TIMER1_TICK)
+ISR(TIMER1_COMPA_vect)
+{
+    tick_count++;
+    tick_stamp = micros();
+    tick_flag = 1;
+}
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////////
 /*
@@ -66,10 +90,51 @@ WidowX::WidowX()
       ca(cos(alpha)), isRelaxed(0), DEFAULT_TIME(2000)
 {
 
+    speed_stamp = clockMicros();
     for (uint8_t i = 0; i < SERVOCOUNT; i++)
     {
         id[i] = i + 1;
+        last_sent[i] = NO_POSITION;
+        last_speed[i] = 0;
+        deadband[i] = 0;
+        servo_speed_stamp[i] = speed_stamp;
     }
+    velocity_ff = 0;
+    speed_target[0] = NO_POSITION;
+    ik_branch = 0;
+    gamma_window = 0;
+    speed_projection = 0;
+    speed_is_polar = 0;
+    chosen_gamma = 0;
+    clearIKCache();
+    clearCalibration();
+    fk_valid = 0;
+    fk_updates = 0;
+    arrival_tolerance = 0;
+    arrival_timeout = 1000;
+    settle_time = 0;
+    motion_active = 0;
+    settle_active = 0;
+    queue_head = 0;
+    queue_count = 0;
+    queue_dropped = 0;
+    trajectory_profile = TRAJ_CUBIC;
+    motion_profile = TRAJ_CUBIC;
+    setInputShaper(SHAPER_NONE, 0, 0);
+    setGovernor(0);
+    gravity_comp = 0;
+    gravity_punch = 0;
+    punch_raised = 0;
+    setLinkMasses(180, 120, 160);
+    payload_mass = 0;
+    for (uint8_t i = 0; i < 4; i++)
+        joint_stiffness[i] = 300000;
+    for (uint8_t i = 0; i < SERVOCOUNT - 1; i++)
+        arrival_offset[i] = 0;
+    bus_bytes_sent = 0;
+    bus_bytes_saved = 0;
+    tick_period = 10000;
+    resetTickStats();
 }
 
 /*
@@ -79,12 +144,16 @@ WidowX::WidowX()
 */
 void WidowX::init(uint8_t relax)
 {
-    delay(10);
+    loadCalibration();
+    clockDelay(10);
     checkVoltage();
     moveRest();
-    delay(100);
+    waitForArrival(DEFAULT_TOLERANCE, 1000);
     if (relax)
         relaxServos();
+    speed_stamp = clockMicros();
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+        servo_speed_stamp[i] = speed_stamp;
 }
 
 //ID HANDLERS
@@ -96,6 +165,7 @@ void WidowX::setId(int idx, int newID)
     if (idx < 0 || idx >= SERVOCOUNT)
         return;
     id[idx] = newID;
+    last_sent[idx] = NO_POSITION;
 }
 
 /*
@@ -142,7 +212,7 @@ void WidowX::moveRest()
     updatePoint();
 }
 
-void WidowX::moveToPose(const unsigned int *pose)
+void WidowX::moveToPose(const uint16_t *pose)
 {
     getCurrentPosition();
     interpolateFromPose(pose, DEFAULT_TIME);
@@ -168,7 +238,7 @@ void WidowX::checkVoltage()
     while (voltage <= 10.0)
     {
         Serial.println("Voltage levels below 10v, please charge battery.");
-        delay(1000);
+        clockDelay(1000);
         voltage = (ax12GetRegister(1, AX_PRESENT_VOLTAGE, 1)) / 10.0;
     }
     if (voltage > 10.0)
@@ -211,13 +281,14 @@ void WidowX::getCurrentPosition(uint8_t until_idx)
 */
 int WidowX::getServoPosition(int idx)
 {
+    PROFILE_SCOPE(PROBE_GET_SERVO_POSITION);
     uint8_t i = 0;
     uint16_t prev = current_position[idx];
     current_position[idx] = GetPosition(id[idx]);
     while (current_position[idx] == -1)
     {
         i = (i % 10) + 1;
-        delay(5 * i);
+        clockDelay(5 * i);
         current_position[idx] = GetPosition(id[idx]);
     }
     current_angle[idx] = positionToAngle(idx, current_position[idx]);
@@ -248,6 +319,473 @@ void WidowX::getPoint(float *p)
     p[2] = point[2];
 }
 
+/*
+ * Saves the point [x,y,z] of the gripper into p and its orientation, as seen from the base, 
+ * into R. It does not read the servos: it uses the angles of the last getCurrentPosition, 
+ * getServoAngle or getPoint, so it is cheap enough to check orientation goals
+*/
+void WidowX::getPose(float *p, Matrix<3, 3> &R)
+{
+    solvePose(current_angle, p, R);
+}
+
+/*
+ * Saves the point [x,y,z] into p as getPoint does, but only reads Q1 to Q4 and updates the
+ * point from how much each angle changed since the last call, instead of computing it again.
+ * Meant to follow the arm at a high rate. It does not change the point used by the speed 
+ * functions
+*/
+void WidowX::getPointFast(float *p)
+{
+    getCurrentPosition(3);
+    trackPoint(p);
+}
+
+//Calibration
+/*
+ * Sets the calibration of the servo at idx: its real angle is scale times the nominal angle
+ * plus offset [rad]. The change applies at once, in RAM; call saveCalibration to keep it
+*/
+void WidowX::setCalibration(int idx, float offset, float scale)
+{
+    calibration.offset[idx] = offset;
+    calibration.scale[idx] = scale;
+    applyCalibration(idx);
+    fk_valid = 0;
+}
+
+/*
+ * Sets the table of corrections of the servo at idx: CAL_LUT_POINTS values, in positions, 
+ * evenly spaced from position 0 to the last position of the servo. They are subtracted from
+ * the position read and added to the position written. NULL removes the table
+*/
+void WidowX::setCalibrationTable(int idx, const int8_t *corrections)
+{
+    fk_valid = 0;
+    if (corrections == NULL)
+    {
+        calibration.lut_mask &= ~(1 << idx);
+        return;
+    }
+    for (uint8_t k = 0; k < CAL_LUT_POINTS; k++)
+        calibration.lut[idx][k] = corrections[k];
+    calibration.lut_mask |= 1 << idx;
+}
+
+/*
+ * Goes back to the nominal conversion for every servo. It does not change the EEPROM
+*/
+void WidowX::clearCalibration()
+{
+    calibration.magic = CAL_MAGIC;
+    calibration.lut_mask = 0;
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+    {
+        calibration.offset[i] = 0;
+        calibration.scale[i] = 1;
+        for (uint8_t k = 0; k < CAL_LUT_POINTS; k++)
+            calibration.lut[i][k] = 0;
+        applyCalibration(i);
+    }
+    fk_valid = 0;
+}
+
+/*
+ * Reads the calibration from the EEPROM at CAL_EEPROM_ADDRESS. Returns 0 if it was loaded, 
+ * or 1 if the EEPROM has no valid calibration, in which case the nominal one is used
+*/
+uint8_t WidowX::loadCalibration()
+{
+    eeprom_read_block(&calibration, (const void *)CAL_EEPROM_ADDRESS, sizeof(Calibration));
+    if (calibration.magic != CAL_MAGIC || calibration.checksum != calibrationChecksum())
+    {
+        clearCalibration();
+        return 1;
+    }
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+        applyCalibration(i);
+    fk_valid = 0;
+    return 0;
+}
+
+/*
+ * Writes the current calibration into the EEPROM at CAL_EEPROM_ADDRESS. Only the bytes that
+ * changed are written
+*/
+void WidowX::saveCalibration()
+{
+    calibration.magic = CAL_MAGIC;
+    calibration.checksum = calibrationChecksum();
+    eeprom_update_block(&calibration, (void *)CAL_EEPROM_ADDRESS, sizeof(Calibration));
+}
+
+//Arrival
+/*
+ * Waits until the first five motors are within tolerance positions of the last goal of a move
+ * (desired_position), or until timeout milliseconds have elapsed. Each pass reads the present
+ * position only of the motors that have not arrived yet. Returns the milliseconds it took for
+ * the arm to settle, or -1 if the timeout was reached
+*/
+long WidowX::waitForArrival(uint8_t tolerance, unsigned int timeout)
+{
+    uint8_t pending = 0x1F;
+    const unsigned long start = clockMillis();
+    for (;;)
+    {
+        pending = pollArrival(pending, tolerance);
+        if (!pending)
+            return clockMillis() - start;
+        if (clockMillis() - start >= timeout)
+            return -1;
+        clockYield();
+    }
+}
+
+/*
+ * When tolerance != 0, every interpolated move ends by waiting until the arm is within tolerance
+ * positions of the goal (or until timeout milliseconds), instead of returning right after the last
+ * goal is sent. tolerance = 0 disables the wait, which is the default
+*/
+void WidowX::setArrivalTolerance(uint8_t tolerance, unsigned int timeout)
+{
+    arrival_tolerance = tolerance;
+    arrival_timeout = timeout;
+}
+
+/*
+ * Returns the settle time in milliseconds measured at the end of the last interpolated move,
+ * or -1 if the arm did not arrive before the timeout. Requires setArrivalTolerance()
+*/
+long WidowX::getSettleTime()
+{
+    return settle_time;
+}
+
+//Bus Traffic
+/*
+ * Sets the deadband in positions of the specified motor. While streaming goals (interpolation
+ * and speed control), a motor is left out of the sync write if its new goal differs from the
+ * last one sent by deadband positions or less. The final goal of a move, and the target of 
+ * the speed modes once it stops changing, are always sent exactly.
+*/
+void WidowX::setDeadband(int idx, uint8_t positions)
+{
+    if (idx < 0 || idx >= SERVOCOUNT)
+        return;
+    deadband[idx] = positions;
+}
+
+/*
+ * Sets the same deadband for every motor
+*/
+void WidowX::setDeadband(uint8_t positions)
+{
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+        deadband[i] = positions;
+}
+
+/*
+ * Returns the number of bytes of goal position packets sent to the bus since the last reset
+*/
+unsigned long WidowX::getBytesSent()
+{
+    return bus_bytes_sent;
+}
+
+/*
+ * Returns the number of bytes that were not sent because the goals had not changed
+*/
+unsigned long WidowX::getBytesSaved()
+{
+    return bus_bytes_saved;
+}
+
+void WidowX::resetBusStats()
+{
+    bus_bytes_sent = 0;
+    bus_bytes_saved = 0;
+}
+
+/*
+ * Enables (enable != 0) or disables the velocity feedforward. When enabled, every sample of 
+ * the interpolation sends the goal of the next tick together with the moving speed that 
+ * reaches it on time, obtained from the derivative of the trajectory. When the move ends, 
+ * the moving speed is set back to 0 (maximum speed)
+*/
+void WidowX::setVelocityFeedforward(uint8_t enable)
+{
+    velocity_ff = enable;
+}
+
+//Gravity Compensation
+/*
+ * Enables (enable != 0) or disables the gravity compensation. When enabled, the goals of Q2, Q3
+ * and Q4 are biased by the sag that the model expects at the goal pose, so the arm lands on the
+ * target instead of below it. If adjustPunch != 0, the punch of those motors is also raised at
+ * the start of every move in proportion to the load they will hold. Turning either off gives
+ * the motors back DEFAULT_PUNCH
+*/
+void WidowX::setGravityCompensation(uint8_t enable, uint8_t adjustPunch)
+{
+    gravity_comp = enable;
+    gravity_punch = adjustPunch;
+    if ((!enable || !adjustPunch) && punch_raised)
+    {
+        for (uint8_t i = 1; i < 4; i++)
+            ax12SetRegister2(id[i], AX_PUNCH_L, DEFAULT_PUNCH);
+        punch_raised = 0;
+    }
+}
+
+/*
+ * Sets the masses in grams of the link from Q2 to Q3, the link from Q3 to Q4, and the link from 
+ * Q4 to the center of the gripper (including the wrist and gripper motors)
+*/
+void WidowX::setLinkMasses(float upperArm, float forearm, float wrist)
+{
+    link_mass[0] = upperArm;
+    link_mass[1] = forearm;
+    link_mass[2] = wrist;
+}
+
+/*
+ * Sets the mass in grams of the object held by the gripper
+*/
+void WidowX::setPayload(float mass)
+{
+    payload_mass = mass;
+}
+
+/*
+ * Sets the stiffness of the position control of the specified motor (1 to 3) in g*cm/rad, that 
+ * is, the torque that makes it deviate one radian from its goal
+*/
+void WidowX::setJointStiffness(int idx, float stiffness)
+{
+    if (idx < 1 || idx > 3 || stiffness <= 0)
+        return;
+    joint_stiffness[idx] = stiffness;
+}
+
+//Trajectory Profiles
+/*
+ * Selects the profile of the following moves: TRAJ_CUBIC (default), TRAJ_QUINTIC or TRAJ_SCURVE.
+ * The quintic has no steps of acceleration, and the S-curve also limits the jerk, so they 
+ * excite the arm less than the cubic at the same move time
+*/
+void WidowX::setTrajectoryProfile(uint8_t profile)
+{
+    if (profile > TRAJ_SCURVE)
+        return;
+    trajectory_profile = profile;
+}
+
+//Input Shaping
+/*
+ * Shapes the goals of the interpolated moves and of the speed modes to cancel the vibration
+ * of a mode of the arm of the given frequency [Hz] and damping ratio: every goal is split into
+ * impulses that are sent with a delay, so the vibration started by one is cancelled by the 
+ * next. SHAPER_ZV uses two impulses and lasts half a period of the mode; SHAPER_ZVD uses 
+ * three, lasts a whole period and is less sensitive to errors in the frequency. SHAPER_NONE,
+ * the default, turns it off. Moves take getShaperDelay() milliseconds longer
+*/
+void WidowX::setInputShaper(uint8_t type, float frequency, float damping)
+{
+    shaper_impulses = 1;
+    shaper_amplitude[0] = 1;
+    shaper_delay[0] = 0;
+    shaper_count = 0;
+    if (type == SHAPER_NONE || type > SHAPER_ZVD || frequency <= 0 || damping < 0 || damping >= 1)
+        return;
+
+    const float root = sqrt(1 - damping * damping);
+    const float K = exp(-damping * M_PI / root);
+    const float half_period = 500 / (frequency * root); //[ms]
+    if (type == SHAPER_ZV)
+    {
+        shaper_impulses = 2;
+        shaper_amplitude[0] = 1 / (1 + K);
+        shaper_amplitude[1] = K / (1 + K);
+    }
+    else
+    {
+        shaper_impulses = 3;
+        shaper_amplitude[0] = 1 / ((1 + K) * (1 + K));
+        shaper_amplitude[1] = 2 * K * shaper_amplitude[0];
+        shaper_amplitude[2] = K * K * shaper_amplitude[0];
+    }
+    for (uint8_t k = 1; k < shaper_impulses; k++)
+        shaper_delay[k] = k * half_period;
+    //The history of the speed modes has to cover the longest delay
+    shaper_spacing = 1000 * shaper_delay[shaper_impulses - 1] / (SHAPER_HISTORY - 2);
+}
+
+/*
+ * Returns how many milliseconds the input shaper adds to every move
+*/
+int WidowX::getShaperDelay()
+{
+    return ceil(shaper_delay[shaper_impulses - 1]);
+}
+
+//Control Tick
+/*
+ * Sets the period in microseconds of the control tick that paces the interpolation. 
+ * The default period is 10000us (100Hz). With a 16MHz clock, the maximum period is 32768us
+*/
+void WidowX::setControlPeriod(unsigned long period_us)
+{
+    if (period_us == 0)
+        return;
+    tick_period = period_us;
+    resetTickStats();
+}
+
+/*
+ * Copies the statistics of the measured tick periods into stats. Times are in microseconds
+*/
+void WidowX::getTickStats(TickStats *stats)
+{
+    *stats = tick_stats;
+}
+
+void WidowX::resetTickStats()
+{
+    tick_stats.ticks = 0;
+    tick_stats.overruns = 0;
+    tick_stats.min_period = 0xFFFFFFFF;
+    tick_stats.max_period = 0;
+    tick_stats.mean_period = 0;
+    tick_stats.max_jitter = 0;
+    tick_period_sum = 0;
+}
+
+//Thermal Governor
+/*
+ * Enables (1) or disables (0, the default) the thermal governor. Every GOV_PERIOD ms, while 
+ * the arm moves or updateGovernor() is called, it reads the load, voltage and temperature of
+ * one servo in a single packet and updates a thermal model of it. When a servo is expected to
+ * get within GOV_TEMP_BAND of GOV_TEMP_LIMIT, the moves are made slower and are followed by a
+ * pause, so the arm keeps working instead of stopping with an overheating alarm
+*/
+void WidowX::setGovernor(uint8_t enable)
+{
+    gov_enabled = enable;
+    gov_next = 0;
+    gov_last = clockMillis();
+    gov_reads = 0;
+    gov_ambient = 0;
+    gov_scale = 1;
+    gov_dwell = 0;
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+    {
+        gov_measured[i] = 0;
+        gov_temperature[i] = 0;
+        gov_rate[i] = 0;
+        gov_predicted[i] = 0;
+        gov_gain[i] = 0;
+        gov_load2[i] = 0;
+        gov_load[i] = 0;
+        gov_stamp[i] = gov_last;
+    }
+}
+
+/*
+ * Reads the next servo if GOV_PERIOD ms have elapsed since the last read. The arm calls it
+ * while it moves; call it in the loop of the sketch to keep the model updated while idle
+*/
+void WidowX::updateGovernor()
+{
+    if (!gov_enabled || clockMillis() - gov_last < GOV_PERIOD)
+        return;
+    gov_last = clockMillis();
+    readGovernor(gov_next);
+    gov_next = (gov_next + 1) % SERVOCOUNT;
+}
+
+/*
+ * Copies the state of the thermal governor into stats
+*/
+void WidowX::getGovernorStats(GovernorStats *stats)
+{
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+    {
+        stats->temperature[i] = gov_measured[i];
+        stats->predicted[i] = gov_predicted[i];
+        stats->load[i] = gov_load[i];
+    }
+    stats->scale = gov_scale;
+    stats->dwell = gov_dwell;
+    stats->reads = gov_reads;
+}
+
+/*
+ * Reads the present load, voltage and temperature of the servo at idx (registers 40 to 43)
+ * in one packet and updates its model. A servo heats like a first order system,
+ *     dT/dt = (ambient + gain * load^2 - T) / GOV_TAU
+ * so the temperature it is heading to is T + GOV_TAU * dT/dt. That tells the gain of the servo
+ * under the load it has had, and the gain times the present load tells where it will go if 
+ * the arm keeps working like now. The scale and the dwell follow the hottest prediction
+*/
+void WidowX::readGovernor(uint8_t idx)
+{
+    if (ax12GetRegister(id[idx], AX_PRESENT_LOAD_L, 4) < 0)
+        return;
+    //The status packet stays in ax_rx_buffer of the ArbotiX library; the data starts at 5
+    const int raw = ax_rx_buffer[5] + (ax_rx_buffer[6] << 8);
+    const float measured = ax_rx_buffer[8];
+    const float load = (raw & 0x3FF) / 1023.0;
+    gov_load[idx] = (raw & 0x400) ? -round(load * 1000) : round(load * 1000);
+    gov_reads++;
+
+    const unsigned long now = clockMillis();
+    const float dt = (now - gov_stamp[idx]) / 1000.0;
+    gov_stamp[idx] = now;
+    if (gov_measured[idx] == 0)
+    {
+        //First reading: the servo is taken as cold
+        if (gov_ambient == 0 || measured < gov_ambient)
+            gov_ambient = measured;
+        gov_temperature[idx] = measured;
+        gov_rate[idx] = 0;
+    }
+    gov_measured[idx] = measured;
+    if (dt <= 0)
+        return;
+
+    //The readings are whole degrees and the load changes within a move, so both are smoothed
+    const float k = min(1, dt / GOV_SMOOTHING);
+    const float previous = gov_temperature[idx];
+    gov_temperature[idx] += k * (measured - previous);
+    gov_rate[idx] += k * ((gov_temperature[idx] - previous) / dt - gov_rate[idx]);
+    gov_load2[idx] += k * (load * load - gov_load2[idx]);
+
+    if (gov_load2[idx] > 0.01)
+    {
+        const float heading = gov_temperature[idx] + GOV_TAU * gov_rate[idx];
+        gov_gain[idx] += k * (max(0, heading - gov_ambient) / gov_load2[idx] - gov_gain[idx]);
+    }
+    const float target = gov_ambient + gov_gain[idx] * gov_load2[idx];
+    const float ahead = 1 - exp(-(float)GOV_LOOKAHEAD / GOV_TAU);
+    gov_predicted[idx] = max(measured, gov_temperature[idx] + (target - gov_temperature[idx]) * ahead);
+
+    float scale = 1;
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
+        scale = min(scale, (GOV_TEMP_LIMIT - gov_predicted[i]) / GOV_TEMP_BAND);
+    gov_scale = max(GOV_MIN_SCALE, scale);
+    gov_dwell = GOV_DWELL_MAX * (1 - gov_scale) / (1 - GOV_MIN_SCALE);
+}
+
+/*
+ * Time that a move of time milliseconds takes with the scale of the governor
+*/
+int WidowX::governedTime(int time)
+{
+    if (!gov_enabled || gov_scale >= 1)
+        return time;
+    return time / gov_scale;
+}
+
 //Torque
 /*
  * This function disables the torque of all the servos and sets the global flag isRelaxed to true.
@@ -256,12 +794,24 @@ void WidowX::getPoint(float *p)
  */
 void WidowX::relaxServos()
 {
+    relaxServos(ALL_SERVOS);
+}
+
+/*
+ * Disables the torque of the servos selected by mask, where bit n corresponds to idx n
+ * (e.g. 0b110000 relaxes the wrist rotation and the gripper). All of them are relaxed
+ * with a single SYNC_WRITE packet, so no delays are needed between servos.
+ */
+void WidowX::relaxServos(uint8_t mask)
+{
+    syncWriteTorque(0, mask);
+    isRelaxed |= mask & ALL_SERVOS;
+    //The servos can be moved by hand now, so their goals must be sent again
     for (uint8_t i = 0; i < SERVOCOUNT; i++)
     {
-        Relax(id[i]);
-        delay(10);
+        if ((mask >> i) & 1)
+            last_sent[i] = NO_POSITION;
     }
-    isRelaxed = 1;
 }
 
 /*
@@ -269,12 +819,17 @@ void WidowX::relaxServos()
  */
 void WidowX::torqueServos()
 {
-    for (uint8_t i = 0; i < SERVOCOUNT; i++)
-    {
-        TorqueOn(id[i]);
-        delay(10);
-    }
-    isRelaxed = 0;
+    torqueServos(ALL_SERVOS);
+}
+
+/*
+ * Enables the torque of the servos selected by mask, where bit n corresponds to idx n.
+ * It uses a single SYNC_WRITE packet and does not alter their current positions.
+ */
+void WidowX::torqueServos(uint8_t mask)
+{
+    syncWriteTorque(1, mask);
+    isRelaxed &= ~mask;
 }
 
 //Move Servo
@@ -293,16 +848,16 @@ void WidowX::moveServo2Angle(int idx, float angle)
     {
         while (curr < pos)
         {
-            SetPosition(id[idx], ++curr);
-            delay(1);
+            writePosition(idx, ++curr);
+            clockDelay(1);
         }
     }
     else
     {
         while (curr > pos)
         {
-            SetPosition(id[idx], --curr);
-            delay(1);
+            writePosition(idx, --curr);
+            clockDelay(1);
         }
     }
 }
@@ -321,16 +876,16 @@ void WidowX::moveServo2Position(int idx, int pos)
     {
         while (curr < pos)
         {
-            SetPosition(id[idx], ++curr);
-            delay(1);
+            writePosition(idx, ++curr);
+            clockDelay(1);
         }
     }
     else
     {
         while (curr > pos)
         {
-            SetPosition(id[idx], --curr);
-            delay(1);
+            writePosition(idx, --curr);
+            clockDelay(1);
         }
     }
 }
@@ -369,7 +924,7 @@ void WidowX::moveGrip(int close)
             posQ6 = 512;
         }
     }
-    SetPosition(id[5], posQ6);
+    writePosition(5, posQ6);
 }
 
 /**
@@ -378,20 +933,53 @@ void WidowX::moveGrip(int close)
 */
 void WidowX::setServo2Position(int idx, int position)
 {
-    SetPosition(id[idx], position);
+    writePosition(idx, position);
 }
 
 void WidowX::moveServoWithSpeed(int idx, int speed, long initial_time)
 {
+    stepServoWithSpeed(idx, speed, (long)(clockMillis() - initial_time));
+}
+
+/**
+ * Same as moveServoWithSpeed, but integrates the speed over the time since the last call for
+ * that servo, measured with clockMicros() and clamped to SPEED_DT_MAX. Call it on every frame 
+ * of the controller, even when the speed is 0, so the speed does not depend on the frame rate
+*/
+void WidowX::moveServoWithSpeed(int idx, int speed)
+{
+    const float tf = speedInterval(&servo_speed_stamp[idx]);
+    if (speed)
+        stepServoWithSpeed(idx, speed, tf);
+}
+
+/*
+ * Returns the milliseconds since stamp, at most SPEED_DT_MAX microseconds, and sets stamp to now
+*/
+float WidowX::speedInterval(unsigned long *stamp)
+{
+    const unsigned long now = clockMicros();
+    unsigned long dt = now - *stamp;
+    *stamp = now;
+    if (dt > SPEED_DT_MAX)
+        dt = SPEED_DT_MAX;
+    return dt / 1000.0;
+}
 
-    int tf = millis() - initial_time;
+/*
+ * Moves the servo at idx with the given speed during tf milliseconds
+*/
+void WidowX::stepServoWithSpeed(int idx, int speed, float tf)
+{
+    updateGovernor();
+    tf *= gov_scale;
     int lim_up = 1023;
     if (idx < 4) //MX-28 | MX_64
     {
         lim_up = 4095;
     }
     float_position[idx] = max(0, min(lim_up, float_position[idx] + speed * Ks * tf));
-    SetPosition(id[idx], round(float_position[idx]));
+    writePosition(idx, round(float_position[idx]));
 }
 
 //Move Arm
@@ -412,12 +1000,38 @@ void WidowX::moveServoWithSpeed(int idx, int speed, long initial_time)
 */
 void WidowX::movePointWithSpeed(int vx, int vy, int vz, int vg, long initial_time)
 {
+    stepPointWithSpeed(vx, vy, vz, vg, (long)(clockMillis() - initial_time));
+}
+
+/*
+    Same as movePointWithSpeed, but the velocities are integrated over the time since the 
+    last call of movePointWithSpeed or moveArmWithSpeed without initial_time, measured with 
+    clockMicros() and clamped to SPEED_DT_MAX. Call it on every frame of the controller, even 
+    when every velocity is 0, and the arm keeps the commanded velocity at any frame rate.
+*/
+void WidowX::movePointWithSpeed(int vx, int vy, int vz, int vg)
+{
+    const float tf = speedInterval(&speed_stamp);
+    if (vx || vy || vz || vg)
+        stepPointWithSpeed(vx, vy, vz, vg, tf);
+    else
+        sendSpeedTarget(0);
+}
 
-    int tf = millis() - initial_time;
+/*
+ * Moves the target of movePointWithSpeed during tf milliseconds
+*/
+void WidowX::stepPointWithSpeed(int vx, int vy, int vz, int vg, float tf)
+{
+    updateGovernor();
+    tf *= gov_scale;
+    speedToCartesian();
     speed_points[0] = max(-xy_lim, min(xy_lim, speed_points[0] + vx * Kp * tf));
     speed_points[1] = max(-xy_lim, min(xy_lim, speed_points[1] + vy * Kp * tf));
     speed_points[2] = max(z_lim_down, min(z_lim_up, speed_points[2] + vz * Kp * tf));
     global_gamma = max(-gamma_lim, min(gamma_lim, global_gamma + vg * Kg * tf));
+    if (speed_projection)
+        projectToWorkspace();
     setArmGamma(speed_points[0], speed_points[1], speed_points[2], global_gamma);
 }
 
@@ -434,30 +1048,76 @@ void WidowX::movePointWithSpeed(int vx, int vy, int vz, int vg, long initial_tim
 */
 void WidowX::moveArmWithSpeed(int vx, int vy, int vz, int vg, long initial_time)
 {
-    int tf = millis() - initial_time;
-
-    float theta_0 = atan2(speed_points[1], speed_points[0]);
-    float delta_theta = 4 * vy * Kg * tf;
+    stepArmWithSpeed(vx, vy, vz, vg, (long)(clockMillis() - initial_time));
+}
 
-    float magnitude_U0 = sqrt(pow(speed_points[0], 2) + pow(speed_points[1], 2));
-    float deltaU = vx * Kp * tf;
+/*
+    Same as moveArmWithSpeed, but the velocities are integrated over the time since the 
+    last call of movePointWithSpeed or moveArmWithSpeed without initial_time, as
+    movePointWithSpeed(vx, vy, vz, vg) does.
+*/
+void WidowX::moveArmWithSpeed(int vx, int vy, int vz, int vg)
+{
+    const float tf = speedInterval(&speed_stamp);
+    if (vx || vy || vz || vg)
+        stepArmWithSpeed(vx, vy, vz, vg, tf);
+    else
+        sendSpeedTarget(0);
+}
 
-    float magnitude_Uf = magnitude_U0 + deltaU;
-    float theta_f = theta_0 + delta_theta;
-    speed_points[0] = magnitude_Uf * cos(theta_f);
-    speed_points[1] = magnitude_Uf * sin(theta_f);
+/*
+ * Moves the target of moveArmWithSpeed during tf milliseconds
+*/
+void WidowX::stepArmWithSpeed(int vx, int vy, int vz, int vg, float tf)
+{
+    updateGovernor();
+    tf *= gov_scale;
+
+    //The target is kept as its distance to the axis of Q1 and the angle around it
+    speedToPolar();
+    speed_polar[0] += vx * Kp * tf;
+    speed_polar[1] += 4 * vy * Kg * tf;
+    if (speed_polar[0] < 0)
+    {
+        //Going through the axis of Q1 turns the arm around
+        speed_polar[0] = -speed_polar[0];
+        speed_polar[1] += M_PI;
+    }
+    if (speed_polar[1] > M_PI)
+        speed_polar[1] -= 2 * M_PI;
+    else if (speed_polar[1] < -M_PI)
+        speed_polar[1] += 2 * M_PI;
     speed_points[2] = max(z_lim_down, min(z_lim_up, speed_points[2] + vz * Kp * tf));
     global_gamma = max(-gamma_lim, min(gamma_lim, global_gamma + vg * Kg * tf));
-    setArmGamma(speed_points[0], speed_points[1], speed_points[2], global_gamma);
+    if (speed_projection)
+        projectToWorkspace();
+    setArmPolar(speed_polar[0], speed_polar[1], speed_points[2], global_gamma);
 }
 
-/**
- * Moves the center of the gripper to the specified coordinates Px, Py and Pz, as seen from the base of the robot.
- * It uses getIK_Q4, so it moves the arm while maintaining the position of the fourth motor (wrist). This function
- * only affects Q1, Q2 and Q3. It interpolates the step using a cubic interpolation with the default time.
- * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
+/*
+ * When enabled, movePointWithSpeed and moveArmWithSpeed keep the target inside the workspace
+ * instead of reading the arm back when it leaves it: a target whose wrist is out of reach of 
+ * Q2 and Q3 is moved radially onto the boundary, so the motion along the boundary goes on at 
+ * the commanded rate. A target that is still out of the limits of the joints is dropped and
+ * the last one reached is kept. Disabled by default
+*/
+void WidowX::setSpeedProjection(uint8_t enable)
+{
+    speed_projection = enable;
+    if (speed_is_polar)
+        acceptSpeedTarget(speed_polar[0], speed_polar[1], speed_points[2], global_gamma);
+    else
+        acceptSpeedTarget(speed_points[0], speed_points[1], speed_points[2], global_gamma);
+}
+
+/**
+ * Moves the center of the gripper to the specified coordinates Px, Py and Pz, as seen from the base of the robot.
+ * It uses getIK_Q4, so it moves the arm while maintaining the position of the fourth motor (wrist). This function
+ * only affects Q1, Q2 and Q3. It interpolates the step using a cubic interpolation with the default time.
+ * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
+ * Returns 1 when there is no solution and 0 otherwise
 */
-void WidowX::moveArmQ4(float Px, float Py, float Pz)
+uint8_t WidowX::moveArmQ4(float Px, float Py, float Pz)
 {
     if (isRelaxed)
         torqueServos();
@@ -467,10 +1127,11 @@ void WidowX::moveArmQ4(float Px, float Py, float Pz)
     if (getIK_Q4(Px, Py, Pz))
     {
         Serial.println("No solution for IK!");
-        return;
+        return 1;
     }
 
     interpolate(DEFAULT_TIME);
+    return 0;
 }
 
 /**
@@ -478,22 +1139,24 @@ void WidowX::moveArmQ4(float Px, float Py, float Pz)
  * It uses getIK_Q4, so it moves the arm while maintaining the position of the fourth motor (wrist). This function
  * only affects Q1, Q2 and Q3. It interpolates the step using a cubic interpolation with the given time in milliseconds.
  * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
+ * Returns 1 when there is no solution and 0 otherwise
 */
-void WidowX::moveArmQ4(float Px, float Py, float Pz, int time)
+uint8_t WidowX::moveArmQ4(float Px, float Py, float Pz, int time)
 {
     if (isRelaxed)
         torqueServos();
 
-    t0 = millis();
+    t0 = clockMillis();
     getCurrentPosition();
     if (getIK_Q4(Px, Py, Pz))
     {
         Serial.println("No solution for IK!");
-        return;
+        return 1;
     }
 
-    remainingTime = time - (millis() - t0);
+    remainingTime = time - (clockMillis() - t0);
     interpolate(remainingTime);
+    return 0;
 }
 
 /**
@@ -502,20 +1165,24 @@ void WidowX::moveArmQ4(float Px, float Py, float Pz, int time)
  * to the floor. It uses getIK_Gamma. This function only affects Q1, Q2, Q3, and Q4. 
  * It interpolates the step using a cubic interpolation with the default time.
  * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
+ * With setGammaSearch, the nearest reachable gamma is used instead; getChosenGamma tells which one.
+ * Returns 1 when there is no solution and 0 otherwise
 */
-void WidowX::moveArmGamma(float Px, float Py, float Pz, float gamma)
+uint8_t WidowX::moveArmGamma(float Px, float Py, float Pz, float gamma)
 {
     if (isRelaxed)
         torqueServos();
 
     getCurrentPosition();
-    if (getIK_Gamma(Px, Py, Pz, gamma))
+    if (getIK_Gamma(Px, Py, Pz, gamma) && searchGamma(Px, Py, Pz, &gamma))
     {
         Serial.println("No solution for IK!");
-        return;
+        return 1;
     }
+    chosen_gamma = gamma;
 
     interpolate(DEFAULT_TIME);
+    return 0;
 }
 
 /**
@@ -524,21 +1191,55 @@ void WidowX::moveArmGamma(float Px, float Py, float Pz, float gamma)
  * to the floor. It uses getIK_Gamma. This function only affects Q1, Q2, Q3, and Q4. 
  * It interpolates the step using a cubic interpolation with the given time in milliseconds.
  * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
+ * With setGammaSearch, the nearest reachable gamma is used instead; getChosenGamma tells which one.
+ * Returns 1 when there is no solution and 0 otherwise
 */
-void WidowX::moveArmGamma(float Px, float Py, float Pz, float gamma, int time)
+uint8_t WidowX::moveArmGamma(float Px, float Py, float Pz, float gamma, int time)
 {
     if (isRelaxed)
         torqueServos();
-    t0 = millis();
+    t0 = clockMillis();
     getCurrentPosition();
-    if (getIK_Gamma(Px, Py, Pz, gamma))
+    if (getIK_Gamma(Px, Py, Pz, gamma) && searchGamma(Px, Py, Pz, &gamma))
     {
         Serial.println("No solution for IK!");
-        return;
+        return 1;
     }
+    chosen_gamma = gamma;
 
-    remainingTime = time - (millis() - t0);
+    remainingTime = time - (clockMillis() - t0);
     interpolate(remainingTime);
+    return 0;
+}
+
+/*
+ * When moveArmGamma has no solution for the requested gamma, it looks for the nearest 
+ * reachable gamma up to window radians away on each side and moves with it. 0 disables 
+ * the search, which is the default
+*/
+void WidowX::setGammaSearch(float window)
+{
+    gamma_window = window;
+}
+
+/*
+ * Returns the gamma of the last successful moveArmGamma: the requested one, or the one 
+ * found by the search
+*/
+float WidowX::getChosenGamma()
+{
+    return chosen_gamma;
+}
+
+/*
+ * Searches for the reachable gamma nearest to the requested one within the window set by
+ * setGammaSearch and solves the IK with it. Returns 1 if the search is disabled or finds nothing
+*/
+uint8_t WidowX::searchGamma(float Px, float Py, float Pz, float *gamma)
+{
+    if (gamma_window <= 0 || findGamma(Px, Py, Pz, gamma, gamma_window))
+        return 1;
+    return getIK_Gamma(Px, Py, Pz, *gamma);
 }
 
 /**
@@ -549,8 +1250,9 @@ void WidowX::moveArmGamma(float Px, float Py, float Pz, float gamma, int time)
  * It interpolates the step using a cubic interpolation with the default time.
  * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
  * Rd is a Matrix object as defined by BasicLinearAlgebra.h
+ * Returns 1 when there is no solution and 0 otherwise
 */
-void WidowX::moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
+uint8_t WidowX::moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
 {
     if (isRelaxed)
         torqueServos();
@@ -559,9 +1261,10 @@ void WidowX::moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
     if (getIK_Rd(Px, Py, Pz, Rd))
     {
         Serial.println("No solution for IK!");
-        return;
+        return 1;
     }
     interpolate(DEFAULT_TIME);
+    return 0;
 }
 
 /**
@@ -572,312 +1275,1675 @@ void WidowX::moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
  * It interpolates the step using a cubic interpolation with the given time in milliseconds.
  * If there is no solution for the IK, the arm does not move and a message is printed into the serial monitor.
  * Rd is a Matrix object as defined by BasicLinearAlgebra.h
+ * Returns 1 when there is no solution and 0 otherwise
+*/
+uint8_t WidowX::moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd, int time)
+{
+    if (isRelaxed)
+        torqueServos();
+    t0 = clockMillis();
+    getCurrentPosition();
+    if (getIK_Rd(Px, Py, Pz, Rd))
+    {
+        Serial.println("No solution for IK!");
+        return 1;
+    }
+    remainingTime = time - (clockMillis() - t0);
+    interpolate(remainingTime);
+    return 0;
+}
+
+/**
+ * Moves the center of the gripper to the specified coordinates Px, Py and Pz, 
+ * and with the desired rotation of the coordinate system of the gripper, as 
+ * seen from the base of the robot. It uses getIK_RdBase. This function affects 
+ * Q1, Q2, Q3, Q4, and Q5. It interpolates the step using a cubic interpolation 
+ * with the default time. If there is no solution for the IK, the arm does not move, 
+ * and a message is printed into the serial monitor.
+ * Returns 1 when there is no solution and 0 otherwise
+*/
+uint8_t WidowX::moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase)
+{
+    if (isRelaxed)
+        torqueServos();
+
+    getCurrentPosition();
+    if (getIK_RdBase(Px, Py, Pz, RdBase))
+    {
+        Serial.println("No solution for IK!");
+        return 1;
+    }
+
+    interpolate(DEFAULT_TIME);
+    return 0;
+}
+
+/**
+ * Moves the center of the gripper to the specified coordinates Px, Py and Pz, 
+ * and with the desired rotation of the coordinate system of the gripper, as 
+ * seen from the base of the robot. It uses getIK_RdBase. This function affects 
+ * Q1, Q2, Q3, Q4, and Q5. It interpolates the step using a cubic interpolation 
+ * with the given time in milliseconds. If there is no solution for the IK, the arm does not move, 
+ * and a message is printed into the serial monitor.
+ * Returns 1 when there is no solution and 0 otherwise
 */
-void WidowX::moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd, int time)
+uint8_t WidowX::moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase, int time)
 {
     if (isRelaxed)
         torqueServos();
-    t0 = millis();
+    t0 = clockMillis();
     getCurrentPosition();
+    if (getIK_RdBase(Px, Py, Pz, RdBase))
+    {
+        Serial.println("No solution for IK!");
+        return 1;
+    }
+
+    remainingTime = time - (clockMillis() - t0);
+    interpolate(remainingTime);
+    return 0;
+}
+
+//Retargeting
+/*
+ * Starts moving the center of the gripper to the specified coordinates Px, Py and Pz, with the
+ * desired angle gamma of the gripper, in the given time in milliseconds, without waiting for the
+ * arm to arrive. If the arm is already moving because of a previous retarget, the trajectory is
+ * replanned from the position and velocity it was commanded at, so the arm blends into the new 
+ * goal without stopping. Call updateMotion() in the loop to keep the arm moving. 
+ * Returns 0 if succeeds, returns 1 if there is no solution for the IK (the current motion continues)
+*/
+uint8_t WidowX::retargetArmGamma(float Px, float Py, float Pz, float gamma, int time)
+{
+    if (isRelaxed)
+        torqueServos();
+
+    if (getIK_Gamma(Px, Py, Pz, gamma))
+        return 1;
+
+    retarget(time);
+    return 0;
+}
+
+/*
+ * Same as retargetArmGamma(), but the goal is given as the articular values (in radians) of
+ * the first five motors
+*/
+void WidowX::retargetAngles(const float *angles, int time)
+{
+    if (isRelaxed)
+        torqueServos();
+
+    for (uint8_t i = 0; i < SERVOCOUNT - 1; i++)
+        desired_angle[i] = angles[i];
+    retarget(time);
+}
+
+/*
+ * Sends the next sample of the motion started with a retarget function, if its control tick
+ * is due. After the last goal, it checks whether the arm arrived (setArrivalTolerance) and 
+ * whether the dwell of the thermal governor is over. It does not wait. Returns 1 while the arm
+ * is still moving or settling, 0 once the motion is over.
+ * With the virtual clock, time only advances when the library waits, so the clock is moved 
+ * forward to the next tick instead
+*/
+uint8_t WidowX::updateMotion()
+{
+    if (settle_active)
+        return stepSettle();
+    if (!motion_active)
+        return 0;
+    if (!tickPending() && !isVirtualClock())
+        return 1;
+    if (stepTrajectory())
+        return 1;
+    return stepSettle();
+}
+
+/*
+ * Returns 1 while a motion is being streamed or the arm is settling at its goal
+*/
+uint8_t WidowX::isMoving()
+{
+    return motion_active || settle_active;
+}
+
+//Sequence
+/*
+ * Performs moveArmGamma for every pose in seq, where each row is {Px, Py, Pz, gamma, time}. 
+ * The arm stops at every pose
+*/
+void WidowX::performSequenceGamma(float seq[][5], int num_poses)
+{
+    for (int i = 0; i < num_poses; i++)
+    {
+        moveArmGamma(seq[i][0], seq[i][1], seq[i][2], seq[i][3], (int)seq[i][4]);
+    }
+}
+
+//Motion Queue
+/*
+ * Adds to the end of the motion queue a move of the center of the gripper to Px, Py and Pz with
+ * the angle gamma of the gripper, in time milliseconds. If there is another move after it in the 
+ * queue, the arm does not stop at this point: once it is commanded within tolerance cm of it, 
+ * it blends into the next move. tolerance = 0 stops exactly at the point.
+ * Returns 0 if succeeds, returns 1 if the queue is full
+*/
+uint8_t WidowX::queueArmGamma(float Px, float Py, float Pz, float gamma, int time, float tolerance)
+{
+    if (queue_count >= QUEUE_SIZE)
+        return 1;
+    uint8_t tail = (queue_head + queue_count) % QUEUE_SIZE;
+    queue_type[tail] = QUEUE_GAMMA;
+    queue_profile[tail] = trajectory_profile;
+    queue_goal[tail][0] = Px;
+    queue_goal[tail][1] = Py;
+    queue_goal[tail][2] = Pz;
+    queue_goal[tail][3] = gamma;
+    queue_time[tail] = time;
+    queue_tolerance[tail] = tolerance;
+    queue_count++;
+    return 0;
+}
+
+/*
+ * Adds to the end of the motion queue a move to the given angles in radians of the first five
+ * motors, in time milliseconds. The arm blends into the next move once every motor is commanded
+ * within tolerance radians of its goal. Returns 0 if succeeds, returns 1 if the queue is full
+*/
+uint8_t WidowX::queueAngles(const float *angles, int time, float tolerance)
+{
+    if (queue_count >= QUEUE_SIZE)
+        return 1;
+    uint8_t tail = (queue_head + queue_count) % QUEUE_SIZE;
+    queue_type[tail] = QUEUE_ANGLES;
+    queue_profile[tail] = trajectory_profile;
+    for (uint8_t i = 0; i < SERVOCOUNT - 1; i++)
+        queue_goal[tail][i] = angles[i];
+    queue_time[tail] = time;
+    queue_tolerance[tail] = tolerance;
+    queue_count++;
+    return 0;
+}
+
+/*
+ * Executes the motion queue without waiting. Call it continuously in the loop. When the arm is 
+ * stopped, it starts the next move in the queue. While moving, it looks ahead: if there is a next
+ * move and the arm is already within the tolerance of the current goal, it blends into the next
+ * move from the commanded position and velocity. Moves without IK solution are dropped and a 
+ * message is printed into the serial monitor. Returns 1 while there are moves left
+*/
+uint8_t WidowX::updateQueue()
+{
+    if (motion_active && queue_count && active_tolerance > 0 && withinTolerance())
+        startNextQueued();
+    else if (!motion_active && !settle_active && queue_count)
+        startNextQueued();
+
+    return updateMotion() || queue_count;
+}
+
+/*
+ * Executes the whole motion queue and returns when the arm reaches the last goal
+*/
+void WidowX::runQueue()
+{
+    while (updateQueue())
+        ;
+}
+
+/*
+ * Removes all the moves that have not been started from the queue
+*/
+void WidowX::clearQueue()
+{
+    queue_head = 0;
+    queue_count = 0;
+}
+
+/*
+ * Returns the number of moves waiting in the queue
+*/
+uint8_t WidowX::queueLength()
+{
+    return queue_count;
+}
+
+/*
+ * Returns how many queued moves were dropped because their IK had no solution, since the
+ * instance was created
+*/
+unsigned long WidowX::getDroppedMoves()
+{
+    return queue_dropped;
+}
+
+//Kinematics
+/*
+ * Solves the IK with a desired angle gamma for the gripper without moving the arm nor reading
+ * the servos. On success, writes Q1 to Q4 into angles and returns 0; returns 1 if there is no
+ * solution. Different instances of the class can solve at the same time
+*/
+uint8_t WidowX::solveIK_Gamma(float Px, float Py, float Pz, float gamma, float *angles)
+{
+    if (getIK_Gamma(Px, Py, Pz, gamma))
+        return 1;
+    for (uint8_t i = 0; i < 4; i++)
+        angles[i] = desired_angle[i];
+    return 0;
+}
+
+/*
+ * Solves the IK with a desired rotation Rd, as seen from {1}, without moving the arm nor 
+ * reading the servos. On success, writes Q1 to Q5 into angles and returns 0; returns 1 if 
+ * there is no solution
+*/
+uint8_t WidowX::solveIK_Rd(float Px, float Py, float Pz, Matrix<3, 3> &Rd, float *angles)
+{
     if (getIK_Rd(Px, Py, Pz, Rd))
+        return 1;
+    for (uint8_t i = 0; i < 5; i++)
+        angles[i] = desired_angle[i];
+    return 0;
+}
+
+/*
+ * Returns which of the two solutions of Q3 (elbow) the last successful IK used: 0 for the
+ * one that is tried first and 1 for the other one
+*/
+uint8_t WidowX::getIKBranch()
+{
+    return ik_branch;
+}
+
+/*
+ * Returns the smallest distance, in radians, from Q2, Q3 and Q4 in angles to their limits.
+ * The farther from the limits, the more room the arm has to move around that pose
+*/
+float WidowX::getLimitMargin(const float *angles)
+{
+    float margin = min(angles[1] - q2Lim[0], q2Lim[1] - angles[1]);
+    margin = min(margin, min(angles[2] - q3Lim[0], q3Lim[1] - angles[2]));
+    return min(margin, min(angles[3] - q4Lim[0], q4Lim[1] - angles[3]));
+}
+
+/*
+ * Finds the gamma nearest to the given one, at most window radians away, for which the point
+ * Px, Py, Pz has a solution, and writes it into gamma. Gamma is first bracketed by sampling 
+ * GAMMA_SEARCH_STEPS points on each side, nearest first, and then the edge of the reachable 
+ * range is refined by bisection. Only the trig of the wrist depends on gamma, so q1 and the 
+ * distance to the base are obtained once. Returns 0 if it finds one, or 1 if there is none 
+ * and gamma is not changed
+*/
+uint8_t WidowX::findGamma(float Px, float Py, float Pz, float *gamma, float window)
+{
+    float q[3];
+    uint8_t branch;
+    const float r = sqrt(pow(Px, 2) + pow(Py, 2));
+    const float z = Pz - L0;
+    const float step = window / GAMMA_SEARCH_STEPS;
+
+    if (!solveElbow(r, z, *gamma, q, &branch))
+        return 0;
+
+    float best = 0, best_distance = window + 1;
+    for (uint8_t k = 1; k <= GAMMA_SEARCH_STEPS && best_distance > window; k++)
+    {
+        for (int8_t side = -1; side <= 1; side += 2)
+        {
+            float reachable = *gamma + side * k * step;
+            if (solveElbow(r, z, reachable, q, &branch))
+                continue;
+
+            //The sample before was out of reach: the edge is between both
+            float unreachable = *gamma + side * (k - 1) * step;
+            for (uint8_t i = 0; i < GAMMA_SEARCH_ITERATIONS; i++)
+            {
+                const float middle = (reachable + unreachable) / 2;
+                if (solveElbow(r, z, middle, q, &branch))
+                    unreachable = middle;
+                else
+                    reachable = middle;
+            }
+            if (abs(reachable - *gamma) < best_distance)
+            {
+                best = reachable;
+                best_distance = abs(reachable - *gamma);
+            }
+        }
+    }
+    if (best_distance > window)
+        return 1;
+    *gamma = best;
+    return 0;
+}
+
+/*
+ * Empties the cache of getIK_Gamma and resets its statistics. The cache keeps angles, which do
+ * not depend on the calibration, so changing the calibration does not need it
+*/
+void WidowX::clearIKCache()
+{
+#if IK_CACHE_SETS > 0
+    for (uint16_t s = 0; s < IK_CACHE_SETS; s++)
+        for (uint8_t w = 0; w < IK_CACHE_WAYS; w++)
+            ik_cache[s][w].used = 0;
+    ik_cache_clock = 0;
+#endif
+    ik_cache_hits = 0;
+    ik_cache_misses = 0;
+}
+
+/*
+ * Writes how many calls to getIK_Gamma were answered by the cache (hits) and how many had 
+ * to solve the IK (misses) since the last clearIKCache
+*/
+void WidowX::getIKCacheStats(unsigned long *hits, unsigned long *misses)
+{
+    *hits = ik_cache_hits;
+    *misses = ik_cache_misses;
+}
+
+/*
+ * Forward kinematics of Q1 to Q4 in angles, as updatePoint does but without reading the 
+ * servos. Writes Px, Py, Pz and gamma into pose
+*/
+void WidowX::solveFK(const float *angles, float *pose)
+{
+    forwardKinematics(angles, pose);
+    pose[3] = -angles[1] - angles[2] - angles[3];
+}
+
+/*
+ * Full forward kinematics of Q1 to Q5: the point [x,y,z] of the gripper into p and its 
+ * rotation as seen from the base into R. These are the closed-form expressions of the chain 
+ * in Matlab/WidowXFK.m, where the rotation reduces to R = Rz(q1)*Ry(gamma)*Rx(q5), the same 
+ * convention that getIK_Rd inverts
+*/
+void WidowX::solvePose(const float *angles, float *p, Matrix<3, 3> &R)
+{
+    const float q23 = angles[1] + angles[2];
+    const float gamma = -q23 - angles[3];
+    const float c1 = cos(angles[0]), s1 = sin(angles[0]);
+    const float cg = cos(gamma), sg = sin(gamma);
+    const float c5 = cos(angles[4]), s5 = sin(angles[4]);
+    const float c1sg = c1 * sg, s1sg = s1 * sg;
+
+    const float phi = D * cos(alpha + angles[1]) + L3 * cos(q23) + L4 * cg;
+    p[0] = c1 * phi;
+    p[1] = s1 * phi;
+    p[2] = L0 + D * sin(alpha + angles[1]) + L3 * sin(q23) - L4 * sg;
+
+    R = {c1 * cg, c1sg * s5 - s1 * c5, c1sg * c5 + s1 * s5,
+         s1 * cg, s1sg * s5 + c1 * c5, s1sg * c5 - c1 * s5,
+         -sg, cg * s5, cg * c5};
+}
+
+/*
+ * Rounds the first numServos angles to the closest position of their servo, which is where
+ * the servo would really go: 0.088° for the MX and 0.29° for the AX-12
+*/
+void WidowX::quantizeAngles(float *angles, uint8_t numServos)
+{
+    for (uint8_t i = 0; i < numServos; i++)
+        angles[i] = positionToAngle(i, angleToPosition(i, angles[i]));
+}
+
+//Rotations
+void WidowX::rotz(float angle, Matrix<3, 3> &Rz)
+{
+    Rz = {cos(angle), -sin(angle), 0,
+          sin(angle), cos(angle), 0,
+          0, 0, 1};
+}
+
+void WidowX::roty(float angle, Matrix<3, 3> &Ry)
+{
+    Ry = {cos(angle), 0, sin(angle),
+          0, 1, 0,
+          -sin(angle), 0, cos(angle)};
+}
+
+void WidowX::rotx(float angle, Matrix<3, 3> &Rx)
+{
+    Rx = {1, 0, 0,
+          0, cos(angle), -sin(angle),
+          0, sin(angle), cos(angle)};
+}
+
+//////////////////////////////////////////////////////////////////////////////////////
+/*
+    *** PRIVATE FUNCTIONS ***
+*/
+
+//Conversions
+float WidowX::positionToAngle(int idx, int position)
+{
+    if (calibration.lut_mask & (1 << idx))
+        return angle_gain[idx] * (position - tableCorrection(idx, position) - zero_position[idx]);
+    return angle_gain[idx] * (position - zero_position[idx]);
+}
+int WidowX::angleToPosition(int idx, float angle)
+{
+    PROFILE_SCOPE(PROBE_ANGLE_TO_POSITION);
+    if (abs(angle) > M_PI)
+    {
+        if (angle > 0)
+            angle -= 2 * M_PI;
+        else
+            angle += 2 * M_PI;
+    }
+    float position = position_gain[idx] * angle + zero_position[idx];
+    if (calibration.lut_mask & (1 << idx))
+        position += tableCorrection(idx, position);
+    return round(position);
+}
+
+/*
+ * Fuses the calibration of a servo with its nominal conversion, so converting between 
+ * angles and positions costs the same with or without calibration:
+ * angle = scale * gain * (position - zero) + offset = angle_gain * (position - zero_position)
+*/
+void WidowX::applyCalibration(int idx)
+{
+    angle_gain[idx] = calibration.scale[idx] * nominal_gain[idx];
+    position_gain[idx] = 1 / angle_gain[idx];
+    zero_position[idx] = nominal_zero[idx] - calibration.offset[idx] * position_gain[idx];
+}
+
+/*
+ * Correction, in positions, of the table of the servo at the given position. The points of 
+ * the table are evenly spaced from position 0 to the last position of the servo
+*/
+float WidowX::tableCorrection(int idx, float position)
+{
+    const float last = idx < 4 ? 4095 : 1023;
+    float x = position * (CAL_LUT_POINTS - 1) / last;
+    if (x <= 0)
+        return calibration.lut[idx][0];
+    if (x >= CAL_LUT_POINTS - 1)
+        return calibration.lut[idx][CAL_LUT_POINTS - 1];
+    const uint8_t k = x;
+    x -= k;
+    return calibration.lut[idx][k] + x * (calibration.lut[idx][k + 1] - calibration.lut[idx][k]);
+}
+
+uint8_t WidowX::calibrationChecksum()
+{
+    const uint8_t *data = (const uint8_t *)&calibration;
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < sizeof(Calibration) - 1; i++)
+        checksum += data[i];
+    return ~checksum;
+}
+
+//Poses and interpolation
+
+void WidowX::updatePoint()
+{
+    PROFILE_SCOPE(PROBE_UPDATE_POINT);
+    getCurrentPosition();
+    forwardKinematics(current_angle, point);
+    global_gamma = -current_angle[1] - current_angle[2] - current_angle[3];
+    speed_points[0] = point[0];
+    speed_points[1] = point[1];
+    speed_points[2] = point[2];
+    speed_is_polar = 0;
+    acceptSpeedTarget(point[0], point[1], point[2], global_gamma);
+}
+
+/*
+ * Converts desired_angle into desired_position for the first numServos motors. With gravity
+ * compensation, the goals of Q2, Q3 and Q4 are biased by the sag expected at the goal pose,
+ * and if adjustPunch != 0 the punch of those motors is set according to their load
+*/
+void WidowX::setDesiredPositions(uint8_t numServos, uint8_t adjustPunch)
+{
+    uint8_t i;
+    float tau[4];
+    if (gravity_comp)
+        gravityTorque(desired_angle, tau);
+
+    for (i = 0; i < numServos; i++)
+    {
+        desired_position[i] = angleToPosition(i, desired_angle[i]);
+        arrival_offset[i] = 0;
+        if (gravity_comp && i > 0 && i < 4)
+        {
+            int biased = angleToPosition(i, desired_angle[i] + tau[i] / joint_stiffness[i]);
+            arrival_offset[i] = biased - desired_position[i];
+            desired_position[i] = biased;
+            if (adjustPunch && gravity_punch)
+            {
+                ax12SetRegister2(id[i], AX_PUNCH_L, min(1023, DEFAULT_PUNCH + round((1023 - DEFAULT_PUNCH) * abs(tau[i]) / stall_torque[i])));
+                punch_raised = 1;
+            }
+        }
+    }
+}
+
+/*
+ * Obtains the torque [g*cm] that gravity exerts on Q2, Q3 and Q4 (tau[1..3]) at the pose given 
+ * by the angles q, from the masses of the links and the payload. Each link's mass is placed at 
+ * its middle, and the payload at the center of the gripper. A positive torque pulls the joint 
+ * towards negative angles, so the expected sag is -tau / stiffness
+*/
+void WidowX::gravityTorque(const float *q, float *tau)
+{
+    const float c2 = cos(alpha + q[1]);
+    const float c23 = cos(q[1] + q[2]);
+    const float c234 = cos(q[1] + q[2] + q[3]);
+    tau[0] = 0;
+    tau[3] = (link_mass[2] * L4 / 2 + payload_mass * L4) * c234;
+    tau[2] = (link_mass[1] * L3 / 2 + (link_mass[2] + payload_mass) * L3) * c23 + tau[3];
+    tau[1] = (link_mass[0] * D / 2 + (link_mass[1] + link_mass[2] + payload_mass) * D) * c2 + tau[2];
+}
+
+/*
+ * Obtains the point [x,y,z] of the center of the gripper, as seen from the base of the robot,
+ * for the given angles of the first four motors
+*/
+void WidowX::forwardKinematics(const float *q, float *p)
+{
+    const float phi = D * cos(alpha + q[1]) + L3 * cos(q[1] + q[2]) + L4 * cos(q[1] + q[2] + q[3]);
+    p[0] = cos(q[0]) * phi;
+    p[1] = sin(q[0]) * phi;
+    p[2] = L0 + D * sin(alpha + q[1]) + L3 * sin(q[1] + q[2]) + L4 * sin(q[1] + q[2] + q[3]);
+}
+
+/*
+ * Incremental forward kinematics. The point only depends on the sine and cosine of four 
+ * angles: q1, alpha + q2, q2 + q3 and q2 + q3 + q4. They are kept between calls and, when 
+ * the angles change a little, they are rotated with the angle-addition identities, using a 
+ * short series for the sine and cosine of the change, so no sin() or cos() is evaluated. 
+ * Bigger changes, and the first call, compute them again. Every FK_RENORMALIZE updates, 
+ * each pair is scaled back to a length of 1 so the rounding errors do not grow
+*/
+void WidowX::trackPoint(float *p)
+{
+    const float angle[4] = {current_angle[0], alpha + current_angle[1], current_angle[1] + current_angle[2],
+                            current_angle[1] + current_angle[2] + current_angle[3]};
+    if (!fk_valid)
+    {
+        for (uint8_t k = 0; k < 4; k++)
+        {
+            fk_cos[k] = cos(angle[k]);
+            fk_sin[k] = sin(angle[k]);
+            fk_angle[k] = angle[k];
+        }
+        fk_valid = 1;
+    }
+    else
+    {
+        for (uint8_t k = 0; k < 4; k++)
+            rotateTrackedAngle(k, angle[k]);
+
+        if (++fk_updates >= FK_RENORMALIZE)
+        {
+            for (uint8_t k = 0; k < 4; k++)
+            {
+                //First order of 1/sqrt(x) around 1, enough for the error of a few updates
+                const float scale = 1.5 - 0.5 * (fk_cos[k] * fk_cos[k] + fk_sin[k] * fk_sin[k]);
+                fk_cos[k] *= scale;
+                fk_sin[k] *= scale;
+            }
+            fk_updates = 0;
+        }
+    }
+
+    const float phi = D * fk_cos[1] + L3 * fk_cos[2] + L4 * fk_cos[3];
+    p[0] = fk_cos[0] * phi;
+    p[1] = fk_sin[0] * phi;
+    p[2] = L0 + D * fk_sin[1] + L3 * fk_sin[2] + L4 * fk_sin[3];
+}
+
+/*
+ * Rotates the tracked sine and cosine k to the new angle. Up to FK_DELTA_MAX, the sine and 
+ * cosine of the change come from their series, exact to 1e-10; beyond it, they are 
+ * computed again
+*/
+void WidowX::rotateTrackedAngle(uint8_t k, float angle)
+{
+    const float delta = angle - fk_angle[k];
+    if (delta == 0)
+        return;
+    fk_angle[k] = angle;
+    if (abs(delta) > FK_DELTA_MAX)
+    {
+        fk_cos[k] = cos(angle);
+        fk_sin[k] = sin(angle);
+        return;
+    }
+    const float d2 = delta * delta;
+    const float c = 1 - d2 * (0.5 - d2 / 24);
+    const float s = delta * (1 - d2 / 6);
+    const float ck = fk_cos[k];
+    fk_cos[k] = ck * c - fk_sin[k] * s;
+    fk_sin[k] = fk_sin[k] * c + ck * s;
+}
+
+void WidowX::cubeInterpolation(Matrix<4> &params, float *w, int time)
+{
+    const float tf_1_2 = 1 / pow(time, 2);
+    const float tf_2_3 = 2 / pow(time, 3);
+    const float tf_3_2 = 3 * tf_1_2;
+
+    Matrix<4, 4> M_inv = {1, 0, 0, 0,
+                          0, 0, 1, 0,
+                          -tf_3_2, tf_3_2, -2.0f / time, -1.0f / time,
+                          tf_2_3, -tf_2_3, tf_1_2, tf_1_2};
+    Matrix<4> wi = M_inv * params;
+    *w = wi(0);
+    *(w + 1) = wi(1);
+    *(w + 2) = wi(2);
+    *(w + 3) = wi(3);
+    *(w + 4) = 0;
+    *(w + 5) = 0;
+    return;
+}
+
+/*
+ * Obtains the coefficients of the quintic polynomial that goes from p0 to pf in time milliseconds,
+ * starting with velocity v0 and acceleration a0 and ending with zero velocity and acceleration.
+ * The acceleration is continuous, so it does not step at the start and end of the move 
+ * like the cubic does
+*/
+void WidowX::quinticInterpolation(float p0, float pf, float v0, float a0, float *w, int time)
+{
+    const float T = time;
+    const float d = pf - p0;
+    const float vT = v0 * T, aT2 = a0 * T * T;
+    const float T3 = T * T * T;
+    w[0] = p0;
+    w[1] = v0;
+    w[2] = a0 / 2;
+    w[3] = (20 * d - 12 * vT - 3 * aT2) / (2 * T3);
+    w[4] = (-30 * d + 16 * vT + 3 * aT2) / (2 * T3 * T);
+    w[5] = (12 * d - 6 * vT - aT2) / (2 * T3 * T * T);
+}
+
+/*
+ * Evaluates the normalized jerk-limited S-curve at tau = t / T, from 0 to 1. It has seven phases:
+ * constant jerk, constant acceleration, constant jerk, cruise, and the same three mirrored. The 
+ * acceleration lasts SC_TA of the move, of which SC_TJ are spent changing it. Saves the normalized
+ * position (0 to 1), velocity and acceleration into s, v and a
+*/
+void WidowX::sCurve(float tau, float *s, float *v, float *a)
+{
+    uint8_t mirror = tau > 0.5;
+    if (mirror)
+        tau = 1 - tau;
+
+    if (tau <= 0)
+    {
+        *s = *v = *a = 0;
+    }
+    else if (tau < SC_TJ)
+    {
+        *a = sc_jerk * tau;
+        *v = *a * tau / 2;
+        *s = *v * tau / 3;
+    }
+    else if (tau < SC_TA - SC_TJ)
+    {
+        const float d = tau - SC_TJ;
+        *a = sc_acc;
+        *v = sc_acc * SC_TJ / 2 + sc_acc * d;
+        *s = sc_acc * SC_TJ * SC_TJ / 6 + sc_acc * SC_TJ / 2 * d + sc_acc * d * d / 2;
+    }
+    else if (tau < SC_TA)
+    {
+        const float r = SC_TA - tau;
+        *a = sc_jerk * r;
+        *v = sc_vel - *a * r / 2;
+        *s = sc_vel * SC_TA / 2 - sc_vel * r + *a * r * r / 6;
+    }
+    else
+    {
+        *a = 0;
+        *v = sc_vel;
+        *s = sc_vel * SC_TA / 2 + sc_vel * (tau - SC_TA);
+    }
+
+    if (mirror)
+    {
+        *s = 1 - *s;
+        *a = -*a;
+    }
+}
+
+void WidowX::interpolate(int remTime)
+{
+    uint8_t i;
+    remTime = governedTime(remTime);
+    setDesiredPositions(SERVOCOUNT - 1, 1);
+    if (remTime <= 0)
+    {
+        writeGoal();
+        while (stepSettle())
+            ;
+        return;
+    }
+    for (i = 0; i < SERVOCOUNT - 1; i++)
+    {
+        planJoint(i, current_position[i], desired_position[i], 0, 0, remTime, trajectory_profile);
+    }
+    motion_profile = trajectory_profile;
+
+    streamTrajectory(remTime);
+}
+
+void WidowX::interpolateFromPose(const uint16_t *pose, int remTime)
+{
+    uint8_t i;
+    remTime = governedTime(remTime);
+    for (i = 0; i < SERVOCOUNT - 1; i++)
+    {
+        //Poses are positions of a servo without calibration: go to the angle they mean
+        desired_position[i] = pgm_read_word_near(pose + i);
+        if (calibration.offset[i] != 0 || calibration.scale[i] != 1 || (calibration.lut_mask & (1 << i)))
+            desired_position[i] = angleToPosition(i, nominal_gain[i] * (desired_position[i] - nominal_zero[i]));
+        arrival_offset[i] = 0;
+    }
+    if (remTime <= 0)
+    {
+        writeGoal();
+        while (stepSettle())
+            ;
+        return;
+    }
+    for (i = 0; i < SERVOCOUNT - 1; i++)
+        planJoint(i, current_position[i], desired_position[i], 0, 0, remTime, trajectory_profile);
+    motion_profile = trajectory_profile;
+
+    streamTrajectory(remTime);
+}
+
+/*
+ * Sends the trajectory stored in W to the first five motors, one sync write per control tick,
+ * until remTime milliseconds have elapsed. The time of each sample is taken from the number of
+ * ticks counted by the timer, so a slow tick does not stretch the move. Finally, it sends the 
+ * desired_position exactly
+*/
+void WidowX::streamTrajectory(int remTime)
+{
+    beginTrajectory(remTime);
+    while (stepTrajectory())
+        ;
+    while (stepSettle())
+        ;
+}
+
+/*
+ * Starts the control tick and sends the first sample of the trajectory stored in W, which
+ * lasts remTime milliseconds. The rest of the samples are sent by stepTrajectory()
+*/
+void WidowX::beginTrajectory(int remTime)
+{
+    shaper_count = 0;
+    speed_target[0] = NO_POSITION;
+    settle_active = 0;
+    motion_time = remTime;
+    motion_t = 0;
+    motion_tick0 = 0;
+    motion_active = 1;
+    startTick();
+    if (remTime > 0)
+        sendTrajectorySample(0);
+}
+
+/*
+ * Waits for the next control tick and sends the sample of the trajectory that corresponds 
+ * to it. When the trajectory is over, it sends the final goal, starts the end of the move with
+ * beginSettle() and returns 0; otherwise, it returns 1
+*/
+uint8_t WidowX::stepTrajectory()
+{
+    const float motion_end = motion_time + shaper_delay[shaper_impulses - 1];
+    if (motion_t < motion_end)
+        motion_t = (waitTick() - motion_tick0) * (tick_period / 1000.0);
+    if (motion_t < motion_end)
+    {
+        sendTrajectorySample(motion_t);
+        updateGovernor();
+        return 1;
+    }
+
+    writeGoal();
+    return 0;
+}
+
+/*
+ * Ends the trajectory being streamed, if any, sends desired_position exactly and starts the end
+ * of the move with beginSettle(). A move of no time is only this write, since no trajectory 
+ * can be planned in 0 ms
+*/
+void WidowX::writeGoal()
+{
+    uint8_t i;
+    if (motion_active)
+        stopTick();
+    motion_active = 0;
+    shaper_count = 0;
+    speed_target[0] = NO_POSITION;
+    if (velocity_ff)
+    {
+        //Give the servos back their maximum speed
+        for (i = 0; i < SERVOCOUNT - 1; i++)
+            next_speed[i] = 0;
+        syncWrite(desired_position, next_speed, SERVOCOUNT - 1, 0);
+    }
+    else
+        syncWrite(desired_position, NULL, SERVOCOUNT - 1, 0);
+
+    beginSettle();
+}
+
+/*
+ * Sends the goals of the trajectory stored in W at time t [ms]. With velocity feedforward,
+ * it sends the goal of the next tick along with the speed needed to reach it on time
+*/
+void WidowX::sendTrajectorySample(float t)
+{
+    uint8_t i;
+    if (velocity_ff)
+    {
+        const float t_ff = min(t + tick_period / 1000.0, motion_time + shaper_delay[shaper_impulses - 1]);
+        for (i = 0; i < SERVOCOUNT - 1; i++)
+        {
+            next_position[i] = round(shapedTrajectory(i, t_ff, 0));
+            next_speed[i] = speedToRegister(i, shapedTrajectory(i, (t + t_ff) / 2, 1));
+        }
+        syncWrite(next_position, next_speed, SERVOCOUNT - 1, 1);
+    }
+    else
+    {
+        for (i = 0; i < SERVOCOUNT - 1; i++)
+        {
+            next_position[i] = round(shapedTrajectory(i, t, 0));
+        }
+        syncWrite(next_position, NULL, SERVOCOUNT - 1, 1);
+    }
+}
+
+/*
+ * Plans a new trajectory of time milliseconds towards desired_angle. If a trajectory is being
+ * streamed, the new one starts from the position and velocity that were last commanded, so the 
+ * motion continues without stopping. Otherwise, it starts from the current position at rest.
+ * With input shaping, the impulses of the old trajectory that were still delayed are dropped
+*/
+void WidowX::retarget(int time)
+{
+    uint8_t i;
+    time = governedTime(time);
+    //The S-curve starts at rest, so a running motion is blended with a quintic
+    const uint8_t profile = motion_active && trajectory_profile == TRAJ_SCURVE ? TRAJ_QUINTIC : trajectory_profile;
+    if (!motion_active)
+        getCurrentPosition();
+
+    setDesiredPositions(SERVOCOUNT - 1, 1);
+    if (time <= 0)
+    {
+        writeGoal();
+        return;
+    }
+    for (i = 0; i < SERVOCOUNT - 1; i++)
+    {
+        if (motion_active)
+            planJoint(i, shapedTrajectory(i, motion_t, 0), desired_position[i], shapedTrajectory(i, motion_t, 1),
+                      shapedTrajectory(i, motion_t, 2), time, profile);
+        else
+            planJoint(i, current_position[i], desired_position[i], 0, 0, time, profile);
+    }
+    motion_profile = profile;
+
+    if (motion_active)
+    {
+        //The new trajectory starts at the last tick that was sent
+        motion_tick0 = tick_last_count;
+        motion_t = 0;
+        motion_time = time;
+    }
+    else
+        beginTrajectory(time);
+}
+
+/*
+ * Takes the next move out of the queue and starts it (or blends into it, if the arm is moving).
+ * Moves without IK solution are dropped
+*/
+void WidowX::startNextQueued()
+{
+    uint8_t i;
+    while (queue_count)
+    {
+        const uint8_t idx = queue_head;
+        queue_head = (queue_head + 1) % QUEUE_SIZE;
+        queue_count--;
+
+        if (queue_type[idx] == QUEUE_GAMMA)
+        {
+            if (getIK_Gamma(queue_goal[idx][0], queue_goal[idx][1], queue_goal[idx][2], queue_goal[idx][3]))
+            {
+                Serial.println("No solution for IK!");
+                queue_dropped++;
+                continue;
+            }
+            forwardKinematics(desired_angle, active_goal);
+        }
+        else
+        {
+            for (i = 0; i < SERVOCOUNT - 1; i++)
+                active_goal[i] = desired_angle[i] = queue_goal[idx][i];
+        }
+        active_type = queue_type[idx];
+        active_tolerance = queue_tolerance[idx];
+
+        if (isRelaxed)
+            torqueServos();
+        const uint8_t profile = trajectory_profile;
+        trajectory_profile = queue_profile[idx];
+        retarget(queue_time[idx]);
+        trajectory_profile = profile;
+        return;
+    }
+}
+
+/*
+ * Returns 1 if the arm is being commanded within the tolerance of the goal of the active move.
+ * The bias of the gravity compensation at the goal is taken out of the commanded positions, 
+ * since the goal is unbiased
+*/
+uint8_t WidowX::withinTolerance()
+{
+    uint8_t i;
+    float q[5], p[3];
+    for (i = 0; i < SERVOCOUNT - 1; i++)
+        q[i] = positionToAngle(i, round(shapedTrajectory(i, motion_t, 0)) - arrival_offset[i]);
+
+    if (active_type == QUEUE_ANGLES)
+    {
+        for (i = 0; i < SERVOCOUNT - 1; i++)
+        {
+            if (abs(q[i] - active_goal[i]) > active_tolerance)
+                return 0;
+        }
+        return 1;
+    }
+
+    forwardKinematics(q, p);
+    return pow(p[0] - active_goal[0], 2) + pow(p[1] - active_goal[1], 2) + pow(p[2] - active_goal[2], 2) <= pow(active_tolerance, 2);
+}
+
+/*
+ * Plans the trajectory of motor i from p0 to pf [pos] in time milliseconds with the given profile,
+ * starting with velocity v0 [pos/ms] and acceleration a0 [pos/ms^2] and ending at rest. The cubic
+ * cannot match a0 and the S-curve always starts at rest. The coefficients are saved into W[i]
+*/
+void WidowX::planJoint(uint8_t i, float p0, float pf, float v0, float a0, int time, uint8_t profile)
+{
+    if (profile == TRAJ_SCURVE)
+    {
+        W[i][0] = p0;
+        W[i][1] = pf - p0;
+        W[i][2] = W[i][3] = W[i][4] = W[i][5] = 0;
+    }
+    else if (profile == TRAJ_QUINTIC)
+        quinticInterpolation(p0, pf, v0, a0, W[i], time);
+    else
+    {
+        Matrix<4> params = {p0, pf, v0, 0};
+        cubeInterpolation(params, W[i], time);
+    }
+}
+
+/*
+ * Evaluates the position of motor i at time t [ms] of the trajectory stored in W
+*/
+float WidowX::trajectoryPosition(uint8_t i, float t)
+{
+    if (motion_profile == TRAJ_SCURVE)
+    {
+        float s, v, a;
+        sCurve(t / motion_time, &s, &v, &a);
+        return W[i][0] + W[i][1] * s;
+    }
+    return W[i][0] + t * (W[i][1] + t * (W[i][2] + t * (W[i][3] + t * (W[i][4] + t * W[i][5]))));
+}
+
+/*
+ * Evaluates the velocity [pos/ms] of motor i at time t [ms] of the trajectory stored in W
+*/
+float WidowX::trajectoryVelocity(uint8_t i, float t)
+{
+    if (motion_profile == TRAJ_SCURVE)
+    {
+        float s, v, a;
+        sCurve(t / motion_time, &s, &v, &a);
+        return W[i][1] * v / motion_time;
+    }
+    return W[i][1] + t * (2 * W[i][2] + t * (3 * W[i][3] + t * (4 * W[i][4] + t * 5 * W[i][5])));
+}
+
+/*
+ * Evaluates the acceleration [pos/ms^2] of motor i at time t [ms] of the trajectory stored in W
+*/
+float WidowX::trajectoryAcceleration(uint8_t i, float t)
+{
+    if (motion_profile == TRAJ_SCURVE)
+    {
+        float s, v, a;
+        sCurve(t / motion_time, &s, &v, &a);
+        return W[i][1] * a / (motion_time * motion_time);
+    }
+    return 2 * W[i][2] + t * (6 * W[i][3] + t * (12 * W[i][4] + t * 20 * W[i][5]));
+}
+
+/*
+ * Evaluates the trajectory stored in W as it is sent with input shaping: the sum of the 
+ * impulses of the shaper, each one seeing the trajectory delayed. The trajectory stays at its
+ * ends before and after it. order is 0 for the position, 1 for the velocity and 2 for the 
+ * acceleration
+*/
+float WidowX::shapedTrajectory(uint8_t i, float t, uint8_t order)
+{
+    float value = 0;
+    for (uint8_t k = 0; k < shaper_impulses; k++)
+    {
+        const float tk = t - shaper_delay[k];
+        if (order == 0)
+            value += shaper_amplitude[k] * trajectoryPosition(i, max(0, min(motion_time, tk)));
+        else if (tk >= 0 && tk <= motion_time)
+            value += shaper_amplitude[k] * (order == 1 ? trajectoryVelocity(i, tk) : trajectoryAcceleration(i, tk));
+    }
+    return value;
+}
+
+/*
+ * Converts a velocity in pos/ms into the value of the moving speed register of motor idx.
+ * 0 means maximum speed for the Dynamixels, so the slowest speed that is sent is 1
+*/
+uint16_t WidowX::speedToRegister(int idx, float velocity)
+{
+    float speed = abs(velocity) * (idx < 4 ? Kv_MX : Kv_AX);
+    if (speed < 1)
+        return 1;
+    if (speed > 1023)
+        return 1023;
+    return round(speed);
+}
+
+//Arrival
+/*
+ * Reads once the present position of the motors in the mask pending (bit i for idx i) and 
+ * returns the mask of the ones that are not yet within tolerance positions of desired_position
+*/
+uint8_t WidowX::pollArrival(uint8_t pending, uint8_t tolerance)
+{
+    int pos;
+    for (uint8_t i = 0; i < SERVOCOUNT - 1; i++)
+    {
+        if (!((pending >> i) & 1))
+            continue;
+        pos = GetPosition(id[i]);
+        if (pos == -1)
+            continue;
+        if (abs(pos - ((int)desired_position[i] - arrival_offset[i])) <= tolerance)
+        {
+            current_position[i] = pos;
+            current_angle[i] = positionToAngle(i, pos);
+            float_position[i] = pos;
+            pending &= ~(1 << i);
+        }
+    }
+    return pending;
+}
+
+/*
+ * Starts the end of a move, once its last goal is sent: the wait for the arrival of the arm
+ * (with setArrivalTolerance) or a short pause, followed by the dwell of the thermal governor
+*/
+void WidowX::beginSettle()
+{
+    settle_active = 1;
+    settle_pending = arrival_tolerance ? 0x1F : 0;
+    settle_start = clockMillis();
+    settle_dwell = arrival_tolerance ? 0 : 3;
+    if (gov_enabled)
+        settle_dwell += gov_dwell;
+}
+
+/*
+ * Advances the end of the move started by beginSettle() without waiting: it checks the motors
+ * that have not arrived yet or whether the pause is over. Returns 1 until the end is over.
+ * With the virtual clock, the pause is waited at once
+*/
+uint8_t WidowX::stepSettle()
+{
+    if (!settle_active)
+        return 0;
+    if (settle_pending)
+    {
+        settle_pending = pollArrival(settle_pending, arrival_tolerance);
+        if (settle_pending)
+        {
+            if (clockMillis() - settle_start < arrival_timeout)
+            {
+                clockYield();
+                return 1;
+            }
+            settle_time = -1;
+            settle_pending = 0;
+        }
+        else
+            settle_time = clockMillis() - settle_start;
+        settle_start = clockMillis();
+    }
+
+    const unsigned long elapsed = clockMillis() - settle_start;
+    if (elapsed < settle_dwell)
+    {
+        if (!isVirtualClock())
+            return 1;
+        clockDelay(settle_dwell - elapsed);
+    }
+    settle_active = 0;
+    return 0;
+}
+
+//Control tick
+/*
+ * Starts the control tick. With WIDOWX_TIMER1_TICK on AVR, Timer1 is set in CTC mode with a
+ * prescaler of 8, so the period has a resolution of 0.5us (at 16MHz) and the interrupt only 
+ * raises a flag and stamps the time with micros(). All the bus I/O is done outside of the 
+ * interrupt, in waitTick(). Otherwise the ticks are scheduled with clockMicros()
+*/
+void WidowX::startTick()
+{
+    tick_flag = 0;
+    tick_count = 0;
+    tick_last_count = 0;
+    tick_last_stamp = clockMicros();
+    tick_deadline = tick_last_stamp;
+#if defined(__AVR__) && defined(WIDOWX_TIMER1_TICK)
+    //With the virtual clock, the ticks are counted in software
+    tick_hardware = !isVirtualClock();
+    if (!tick_hardware)
+        return;
+    unsigned long top = tick_period * (F_CPU / 8000000UL);
+    if (top > 65536UL)
+        top = 65536UL;
+    uint8_t oldSREG = SREG;
+    cli();
+    tick_tccr1a = TCCR1A;
+    tick_tccr1b = TCCR1B;
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11); //CTC, clk/8
+    TCNT1 = 0;
+    OCR1A = top - 1;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+    SREG = oldSREG;
+#else
+    tick_hardware = 0;
+#endif
+}
+
+/*
+ * Stops the control tick and gives Timer1 back to its previous configuration (PWM)
+*/
+void WidowX::stopTick()
+{
+#if defined(__AVR__) && defined(WIDOWX_TIMER1_TICK)
+    if (!tick_hardware)
+        return;
+    uint8_t oldSREG = SREG;
+    cli();
+    TIMSK1 &= ~_BV(OCIE1A);
+    TCCR1A = tick_tccr1a;
+    TCCR1B = tick_tccr1b;
+    SREG = oldSREG;
+#endif
+}
+
+/*
+ * Returns 1 if a control tick is due, so that waitTick() returns without waiting
+*/
+uint8_t WidowX::tickPending()
+{
+    if (tick_hardware)
+        return tick_flag;
+    return (long)(clockMicros() - (tick_deadline + tick_period)) >= 0;
+}
+
+/*
+ * Waits for the next control tick and updates the period statistics. Returns the number of 
+ * ticks elapsed since startTick(). If the previous tick took longer than the period, the lost
+ * ticks are counted as overruns and the returned count skips them. Without the timer (host
+ * builds or virtual clock) the ticks are scheduled with clockMicros()
+*/
+unsigned long WidowX::waitTick()
+{
+    unsigned long stamp, count;
+    if (tick_hardware)
+    {
+        while (!tick_flag)
+            ;
+        noInterrupts();
+        stamp = tick_stamp;
+        count = tick_count;
+        tick_flag = 0;
+        interrupts();
+    }
+    else
+    {
+        tick_deadline += tick_period;
+        stamp = clockMicros();
+        if ((long)(stamp - tick_deadline) < 0)
+        {
+            clockDelayMicroseconds(tick_deadline - stamp);
+            stamp = clockMicros();
+        }
+        count = ++tick_count;
+        while ((long)(stamp - tick_deadline) >= (long)tick_period)
+        {
+            tick_deadline += tick_period;
+            count = ++tick_count;
+        }
+    }
+    unsigned long period = stamp - tick_last_stamp;
+    unsigned long jitter = period > tick_period ? period - tick_period : tick_period - period;
+    tick_last_stamp = stamp;
+
+    tick_stats.overruns += count - tick_last_count - 1;
+    tick_last_count = count;
+    tick_stats.ticks++;
+    if (period < tick_stats.min_period)
+        tick_stats.min_period = period;
+    if (period > tick_stats.max_period)
+        tick_stats.max_period = period;
+    if (jitter > tick_stats.max_jitter)
+        tick_stats.max_jitter = jitter;
+    tick_period_sum += period;
+    tick_stats.mean_period = tick_period_sum / tick_stats.ticks;
+    return count;
+}
+
+/**
+ * Moves the center of the gripper to the specified coordinates Px, Py and Pz, as seen from the base of the robot, with the 
+ * desired angle gamma of the gripper. For example, gamma = pi/2 will make the arm a Pick N Drop since the gripper will be heading
+ * to the floor. It uses getIK_Gamma. This function only affects Q1, Q2, Q3, and Q4. 
+ * It does not interpolate the step, since it is designed to be used by a controller that will move the arm
+ * smoothly. If there is no solution for the IK, the arm does not move.
+*/
+void WidowX::setArmGamma(float Px, float Py, float Pz, float gamma)
+{
+    if (isRelaxed)
+        torqueServos();
+
+    //getCurrentPosition();
+    if (getIK_Gamma_Controller(Px, Py, Pz, gamma))
     {
-        Serial.println("No solution for IK!");
+        rejectSpeedTarget();
         return;
     }
-    remainingTime = time - (millis() - t0);
-    interpolate(remainingTime);
+    acceptSpeedTarget(Px, Py, Pz, gamma);
+
+    setDesiredPositions(4, 0);
+    sendSpeedTarget(1);
 }
 
 /**
- * Moves the center of the gripper to the specified coordinates Px, Py and Pz, 
- * and with the desired rotation of the coordinate system of the gripper, as 
- * seen from the base of the robot. It uses getIK_RdBase. This function affects 
- * Q1, Q2, Q3, Q4, and Q5. It interpolates the step using a cubic interpolation 
- * with the default time. If there is no solution for the IK, the arm does not move, 
- * and a message is printed into the serial monitor.
+ * Same as setArmGamma, for a point given by its distance radius to the axis of Q1, the angle
+ * theta around it and the height Pz
 */
-void WidowX::moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase)
+void WidowX::setArmPolar(float radius, float theta, float Pz, float gamma)
 {
     if (isRelaxed)
         torqueServos();
 
-    getCurrentPosition();
-    if (getIK_RdBase(Px, Py, Pz, RdBase))
+    if (getIK_Polar_Controller(radius, theta, Pz, gamma))
     {
-        Serial.println("No solution for IK!");
+        rejectSpeedTarget();
         return;
     }
+    acceptSpeedTarget(radius, theta, Pz, gamma);
 
-    interpolate(DEFAULT_TIME);
+    setDesiredPositions(4, 0);
+    sendSpeedTarget(1);
 }
 
-/**
- * Moves the center of the gripper to the specified coordinates Px, Py and Pz, 
- * and with the desired rotation of the coordinate system of the gripper, as 
- * seen from the base of the robot. It uses getIK_RdBase. This function affects 
- * Q1, Q2, Q3, Q4, and Q5. It interpolates the step using a cubic interpolation 
- * with the given time in milliseconds. If there is no solution for the IK, the arm does not move, 
- * and a message is printed into the serial monitor.
+/*
+ * Sends desired_position to Q1 to Q4 as the new target of the speed modes (if push != 0), or
+ * sends the last target again when the speeds are 0. With input shaping, the target is kept 
+ * in the history and the goals sent mix it with the delayed targets of the history. The 
+ * deadband only applies while the target changes: once it stops, the goals are sent exactly,
+ * as the last goal of an interpolated move
 */
-void WidowX::moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase, int time)
+void WidowX::sendSpeedTarget(uint8_t push)
 {
-    if (isRelaxed)
-        torqueServos();
-    t0 = millis();
-    getCurrentPosition();
-    if (getIK_RdBase(Px, Py, Pz, RdBase))
+    uint8_t i, useDeadband = 0;
+    if (push)
     {
-        Serial.println("No solution for IK!");
-        return;
+        for (i = 0; i < 4; i++)
+        {
+            if (desired_position[i] != speed_target[i])
+                useDeadband = 1;
+            speed_target[i] = desired_position[i];
+        }
     }
 
-    remainingTime = time - (millis() - t0);
-    interpolate(remainingTime);
-}
+    if (shaper_impulses == 1)
+    {
+        if (speed_target[0] != NO_POSITION)
+            syncWrite(speed_target, NULL, 4, useDeadband);
+        return;
+    }
 
-//Sequence
+    const unsigned long now = clockMicros();
+    if (push)
+        pushSpeedTarget(now);
+    if (shaper_count == 0)
+        return;
 
-void WidowX::performSequenceGamma(float[][] seq, int num_poses)
-{
-    for (int i = 0; i < num_poses; i++)
+    float position[4], goal[4] = {0, 0, 0, 0};
+    for (uint8_t k = 0; k < shaper_impulses; k++)
     {
-        moverArmGamma(seq[i][0], seq[i][1], seq[i][2], seq[i][3], (int)seq[i][4])
+        delayedSpeedTarget(now, 1000 * shaper_delay[k], position);
+        for (i = 0; i < 4; i++)
+            goal[i] += shaper_amplitude[k] * position[i];
     }
+    for (i = 0; i < 4; i++)
+        next_position[i] = round(goal[i]);
+    syncWrite(next_position, NULL, 4, useDeadband);
 }
 
-//Rotations
-void WidowX::rotz(float angle, Matrix<3, 3> &Rz)
+/*
+ * Adds desired_position to the history of targets of the speed modes. The first target is 
+ * preceded by the goals last sent, held until then, so the arm starts from them. The newest
+ * target is replaced until it is shaper_spacing after the one before it, so the history 
+ * always covers the longest delay
+*/
+void WidowX::pushSpeedTarget(unsigned long now)
 {
-    Rz = {cos(angle), -sin(angle), 0,
-          sin(angle), cos(angle), 0,
-          0, 0, 1};
-}
+    uint8_t i;
+    if (shaper_count == 0)
+    {
+        shaper_head = 0;
+        shaper_count = 1;
+        shaper_stamp[0] = now;
+        for (i = 0; i < 4; i++)
+            shaper_target[0][i] = last_sent[i] != NO_POSITION ? last_sent[i] : current_position[i];
+    }
 
-void WidowX::roty(float angle, Matrix<3, 3> &Ry)
-{
-    Ry = {cos(angle), 0, sin(angle),
-          0, 1, 0,
-          -sin(angle), 0, cos(angle)};
+    const uint8_t previous = (shaper_head + SHAPER_HISTORY - 1) % SHAPER_HISTORY;
+    if (shaper_count == 1 || shaper_stamp[shaper_head] - shaper_stamp[previous] >= shaper_spacing)
+    {
+        shaper_head = (shaper_head + 1) % SHAPER_HISTORY;
+        if (shaper_count < SHAPER_HISTORY)
+            shaper_count++;
+    }
+    shaper_stamp[shaper_head] = now;
+    for (i = 0; i < 4; i++)
+        shaper_target[shaper_head][i] = desired_position[i];
 }
 
-void WidowX::rotx(float angle, Matrix<3, 3> &Rx)
+/*
+ * Writes into position the target of the speed modes delay microseconds before now, 
+ * interpolated between the targets of the history. Before the oldest one, it is the oldest
+*/
+void WidowX::delayedSpeedTarget(unsigned long now, unsigned long delay, float *position)
 {
-    Rx = {1, 0, 0,
-          0, cos(angle), -sin(angle),
-          0, sin(angle), cos(angle)};
+    uint8_t i, newer = shaper_head;
+    for (uint8_t n = 1; n < shaper_count; n++)
+    {
+        const uint8_t older = (newer + SHAPER_HISTORY - 1) % SHAPER_HISTORY;
+        if (now - shaper_stamp[older] >= delay)
+        {
+            //The delayed time is between older and newer
+            const float span = shaper_stamp[newer] - shaper_stamp[older];
+            const float f = span > 0 ? min(1, (float)(now - delay - shaper_stamp[older]) / span) : 1;
+            for (i = 0; i < 4; i++)
+                position[i] = shaper_target[older][i] + f * (shaper_target[newer][i] - shaper_target[older][i]);
+            return;
+        }
+        newer = older;
+    }
+    for (i = 0; i < 4; i++)
+        position[i] = shaper_target[newer][i];
 }
 
-//////////////////////////////////////////////////////////////////////////////////////
 /*
-    *** PRIVATE FUNCTIONS ***
+ * Remembers the target of the speed modes that was just reached: a and b are x and y, or
+ * the radius and theta when the target is kept in polar coordinates
 */
-
-//Conversions
-float WidowX::positionToAngle(int idx, int position)
+void WidowX::acceptSpeedTarget(float a, float b, float Pz, float gamma)
 {
-    if (idx == 0 || idx == 3 || idx == 2) //MX-28 || MX-64
-        //0 - 4095, 0.088°
-        // 0° - 360°
-        return 0.00153435538637 * (position - 2047.5);
-    else if (idx == 1) //MX-64
-        //0 - 4095, 0.088°
-        // 0° - 360°
-        return -0.00153435538637 * (position - 2047.5);
-    else //AX-12
-        //0-1023
-        //0° - 300°
-        return 0.00511826979472 * (position - 511.5);
+    accepted_point[0] = a;
+    accepted_point[1] = b;
+    accepted_point[2] = Pz;
+    accepted_point[3] = gamma;
+    accepted_polar = speed_is_polar;
 }
 
-int WidowX::angleToPosition(int idx, float angle)
+/*
+ * The target of the speed modes has no solution. Without projection, the target goes back to
+ * where the arm is read to be. With projection, it goes back to the last target reached,
+ * without reading the servos
+*/
+void WidowX::rejectSpeedTarget()
 {
-    if (abs(angle) > M_PI)
+    if (!speed_projection)
     {
-        if (angle > 0)
-            angle -= 2 * M_PI;
-        else
-            angle += 2 * M_PI;
+        updatePoint();
+        return;
     }
-    if (idx == 0 || idx == 3 || idx == 2) //MX-28 || MX-64
-        //0 - 4095, 0.088°
-        // 0° - 360°
-        // return (int)651.74 * angle + 2048;
-        return round(651.739492 * angle + 2047.5);
-
-    else if (idx == 1) //MX-64
-        //0 - 4095, 0.088°
-        // 0° - 360°
-        return round(-651.739492 * angle + 2047.5);
-    else //AX-12
-        //0-1023
-        //0° - 300°
-        return round(195.378524405 * angle + 511.5);
+    if (accepted_polar)
+    {
+        speed_polar[0] = accepted_point[0];
+        speed_polar[1] = accepted_point[1];
+    }
+    else
+    {
+        speed_points[0] = accepted_point[0];
+        speed_points[1] = accepted_point[1];
+    }
+    speed_is_polar = accepted_polar;
+    speed_points[2] = accepted_point[2];
+    global_gamma = accepted_point[3];
 }
 
-//Poses and interpolation
-
-void WidowX::updatePoint()
+/*
+ * Makes the target of the speed modes polar, if it is not already
+*/
+void WidowX::speedToPolar()
 {
-    getCurrentPosition();
-    q1 = current_angle[0];
-    q2 = current_angle[1];
-    q3 = current_angle[2];
-    q4 = current_angle[3];
-
-    phi2 = D * cos(alpha + q2) + L3 * cos(q2 + q3) + L4 * cos(q2 + q3 + q4);
-    global_gamma = -q2 - q3 - q4;
-    point[0] = cos(q1) * phi2;
-    point[1] = sin(q1) * phi2;
-    point[2] = L0 + D * sin(alpha + q2) + L3 * sin(q2 + q3) + L4 * sin(q2 + q3 + q4);
-    speed_points[0] = point[0];
-    speed_points[1] = point[1];
-    speed_points[2] = point[2];
+    if (speed_is_polar)
+        return;
+    speed_polar[0] = sqrt(pow(speed_points[0], 2) + pow(speed_points[1], 2));
+    speed_polar[1] = atan2(speed_points[1], speed_points[0]);
+    speed_is_polar = 1;
 }
 
-void WidowX::cubeInterpolation(Matrix<4> &params, float *w, int time)
+/*
+ * Makes the target of the speed modes Cartesian, if it is not already
+*/
+void WidowX::speedToCartesian()
 {
-    const float tf_1_2 = 1 / pow(time, 2);
-    const float tf_2_3 = 2 / pow(time, 3);
-    const float tf_3_2 = 3 * tf_1_2;
-
-    Matrix<4, 4> M_inv = {1, 0, 0, 0,
-                          0, 0, 1, 0,
-                          -tf_3_2, tf_3_2, -2 / time, -1 / time,
-                          tf_2_3, -tf_2_3, tf_1_2, tf_1_2};
-    Matrix<4> wi = M_inv * params;
-    *w = wi(0);
-    *(w + 1) = wi(1);
-    *(w + 2) = wi(2);
-    *(w + 3) = wi(3);
-    return;
+    if (!speed_is_polar)
+        return;
+    speed_points[0] = speed_polar[0] * cos(speed_polar[1]);
+    speed_points[1] = speed_polar[0] * sin(speed_polar[1]);
+    speed_is_polar = 0;
 }
 
-void WidowX::interpolate(int remTime)
+/*
+ * Moves the target of the speed modes onto the workspace if its wrist is out of reach. With 
+ * gamma fixed, the wrist is at (X, Z) in the plane of the arm, which Q2 and Q3 reach when its
+ * distance to the shoulder is between |D - L3| and D + L3. Out of that ring, the wrist is 
+ * scaled to the nearest circle and the point is rebuilt from it, keeping the direction of Q1.
+ * The result is kept within z_lim_down and z_lim_up
+*/
+void WidowX::projectToWorkspace()
 {
-    uint8_t i;
-    Matrix<4> params;
-    for (i = 0; i < SERVOCOUNT - 1; i++)
-    {
-        desired_position[i] = angleToPosition(i, desired_angle[i]);
-        params(0) = current_position[i];
-        params(1) = desired_position[i];
-        params(2) = 0;
-        params(3) = 0;
+    const float sg = sin(global_gamma), cg = cos(global_gamma);
+    const float r = speed_is_polar ? speed_polar[0] : sqrt(pow(speed_points[0], 2) + pow(speed_points[1], 2));
+    const float X = r - L4 * cg;
+    const float Z = speed_points[2] - L0 + L4 * sg;
+    const float w = sqrt(pow(X, 2) + pow(Z, 2));
+    const float w_max = D + L3 - PROJECTION_MARGIN;
+    const float w_min = abs(D - L3) + PROJECTION_MARGIN;
+
+    if (w <= w_max && w >= w_min)
+        return;
 
-        cubeInterpolation(params, W[i], remTime);
-    }
+    float scale;
+    if (w > w_max)
+        scale = w_max / w;
+    else if (w > 0)
+        scale = w_min / w;
+    else
+        return;
 
-    t0 = millis();
-    currentTime = millis() - t0;
-    while (currentTime < remTime)
+    //The projected wrist may leave the limits of z; then z is clamped and X is moved along that
+    //height onto the ring, or as close to it as that height allows
+    float X_new = X * scale;
+    const float z = max(z_lim_down, min(z_lim_up, Z * scale + L0 - L4 * sg));
+    const float Z_new = z - L0 + L4 * sg;
+    const float w_new = sqrt(pow(X_new, 2) + pow(Z_new, 2));
+    if (w_new > w_max || w_new < w_min)
     {
-        curr_2 = pow(currentTime, 2);
-        curr_3 = pow(currentTime, 3);
-        for (i = 0; i < SERVOCOUNT - 1; i++)
-        {
-            next_position[i] = round(W[i][0] + W[i][1] * currentTime + W[i][2] * curr_2 + W[i][3] * curr_3);
-            SetPosition(id[i], next_position[i]);
-        }
-
-        delay(10);
-        currentTime = millis() - t0;
+        const float w_to = w_new > w_max ? w_max : w_min;
+        const float X_abs = sqrt(max(0.0, pow(w_to, 2) - pow(Z_new, 2)));
+        X_new = X_new < 0 ? -X_abs : X_abs;
     }
 
-    SetPosition(id[0], desired_position[0]);
-    SetPosition(id[1], desired_position[1]);
-    SetPosition(id[2], desired_position[2]);
-    SetPosition(id[3], desired_position[3]);
-    SetPosition(id[4], desired_position[4]);
-    delay(3);
+    const float r_new = X_new + L4 * cg;
+    if (speed_is_polar)
+        speed_polar[0] = r_new;
+    else if (r > 0)
+    {
+        speed_points[0] *= r_new / r;
+        speed_points[1] *= r_new / r;
+    }
+    else
+        speed_points[0] = r_new;
+    speed_points[2] = z;
 }
 
-void WidowX::interpolateFromPose(const unsigned int *pose, int remTime)
+/*
+ * Sends the goal positions of the first numServos motors in one SYNC_WRITE packet. Only the
+ * motors whose goal differs from the last one sent by more than their deadband are included
+ * (useDeadband = 0 includes any motor whose goal changed at all). If no motor changed, the 
+ * packet is not sent. The bytes that were not sent are accumulated in bus_bytes_saved.
+ * If speeds is not NULL, the moving speed of each motor is written in the same packet, right
+ * after its goal position. When useDeadband = 0, a change of speed also includes the motor
+*/
+void WidowX::syncWrite(const uint16_t *positions, const uint16_t *speeds, uint8_t numServos, uint8_t useDeadband)
 {
-    uint8_t i;
-    Matrix<4> params;
-    for (i = 0; i < SERVOCOUNT - 1; i++)
+    PROFILE_SCOPE(PROBE_SYNC_WRITE);
+    int temp;
+    uint8_t i, numChanged = 0;
+    uint8_t changed[6];
+    const uint8_t dataLength = speeds ? 4 : 2; // pos(2byte) [+ speed(2byte)]
+    for (i = 0; i < numServos; i++)
     {
-        desired_position[i] = pgm_read_word_near(pose + i);
-        params(0) = current_position[i];
-        params(1) = desired_position[i];
-        params(2) = 0;
-        params(3) = 0;
+        temp = positions[i] - last_sent[i];
+        changed[i] = last_sent[i] == NO_POSITION || abs(temp) > (useDeadband ? deadband[i] : 0);
+        if (speeds && !useDeadband && speeds[i] != last_speed[i])
+            changed[i] = 1;
+        numChanged += changed[i];
+    }
 
-        cubeInterpolation(params, W[i], remTime);
+    bus_bytes_saved += (1 + dataLength) * (numServos - numChanged);
+    if (numChanged == 0)
+    {
+        bus_bytes_saved += 8; //header + instruction + checksum of the skipped packet
+        return;
     }
+    bus_bytes_sent += 8 + (1 + dataLength) * numChanged;
 
-    t0 = millis();
-    currentTime = millis() - t0;
-    while (currentTime < remTime)
+    int length = 4 + (numChanged * (1 + dataLength)); // id + data
+    int checksum = 254 + length + AX_SYNC_WRITE + dataLength + AX_GOAL_POSITION_L;
+    setTXall();
+    ax12write(0xFF);
+    ax12write(0xFF);
+    ax12write(0xFE);
+    ax12write(length);
+    ax12write(AX_SYNC_WRITE);
+    ax12write(AX_GOAL_POSITION_L);
+    ax12write(dataLength);
+    for (i = 0; i < numServos; i++)
     {
-        curr_2 = pow(currentTime, 2);
-        curr_3 = pow(currentTime, 3);
-        for (i = 0; i < SERVOCOUNT - 1; i++)
+        if (!changed[i])
+            continue;
+        temp = positions[i];
+        checksum += (temp & 0xff) + (temp >> 8) + id[i];
+        ax12write(id[i]);
+        ax12write(temp & 0xff);
+        ax12write(temp >> 8);
+        last_sent[i] = temp;
+        if (speeds)
         {
-            next_position[i] = round(W[i][0] + W[i][1] * currentTime + W[i][2] * curr_2 + W[i][3] * curr_3);
-            SetPosition(id[i], next_position[i]);
+            temp = speeds[i];
+            checksum += (temp & 0xff) + (temp >> 8);
+            ax12write(temp & 0xff);
+            ax12write(temp >> 8);
+            last_speed[i] = temp;
         }
-
-        delay(10);
-        currentTime = millis() - t0;
     }
-
-    SetPosition(id[0], desired_position[0]);
-    SetPosition(id[1], desired_position[1]);
-    SetPosition(id[2], desired_position[2]);
-    SetPosition(id[3], desired_position[3]);
-    SetPosition(id[4], desired_position[4]);
-    // SetPosition(id[5], desired_position[5]);
-    delay(3);
+    ax12write(0xff - (checksum % 256));
+    setRX(0);
 }
 
-/**
- * Moves the center of the gripper to the specified coordinates Px, Py and Pz, as seen from the base of the robot, with the 
- * desired angle gamma of the gripper. For example, gamma = pi/2 will make the arm a Pick N Drop since the gripper will be heading
- * to the floor. It uses getIK_Gamma. This function only affects Q1, Q2, Q3, and Q4. 
- * It does not interpolate the step, since it is designed to be used by a controller that will move the arm
- * smoothly. If there is no solution for the IK, the arm does not move.
+/*
+ * Sets the goal position of a single motor with a WRITE_DATA packet and keeps track of it,
+ * so that the following sync writes know which goal the motor already has
 */
-void WidowX::setArmGamma(float Px, float Py, float Pz, float gamma)
+void WidowX::writePosition(uint8_t idx, int position)
 {
-    if (isRelaxed)
-        torqueServos();
-
-    //getCurrentPosition();
-    if (getIK_Gamma_Controller(Px, Py, Pz, gamma))
+    SetPosition(id[idx], position);
+    last_sent[idx] = position;
+    if (idx < 4)
     {
-        updatePoint();
-        return;
+        shaper_count = 0;
+        speed_target[0] = NO_POSITION;
     }
+    bus_bytes_sent += 9;
+}
 
-    for (int i = 0; i < 4; i++)
+/*
+ * Writes the torque enable register of every servo selected by mask (bit n --> idx n)
+ * in one SYNC_WRITE packet. enable = 1 turns the torque on, enable = 0 relaxes the servos
+ */
+void WidowX::syncWriteTorque(uint8_t enable, uint8_t mask)
+{
+    uint8_t numServos = 0;
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
     {
-        desired_position[i] = angleToPosition(i, desired_angle[i]);
-        // SetPosition(id[i], desired_position[i]);
+        if ((mask >> i) & 1)
+            numServos++;
     }
-    syncWrite(4);
-}
+    if (numServos == 0)
+        return;
 
-void WidowX::syncWrite(uint8_t numServos)
-{
-    int temp;
-    int length = 4 + (numServos * 3); // 3 = id + pos(2byte)
-    int checksum = 254 + length + AX_SYNC_WRITE + 2 + AX_GOAL_POSITION_L;
+    int length = 4 + (numServos * 2); // 2 = id + torque enable(1byte)
+    int checksum = 254 + length + AX_SYNC_WRITE + 1 + AX_TORQUE_ENABLE;
     setTXall();
     ax12write(0xFF);
     ax12write(0xFF);
     ax12write(0xFE);
     ax12write(length);
     ax12write(AX_SYNC_WRITE);
-    ax12write(AX_GOAL_POSITION_L);
-    ax12write(2);
-    for (int i = 0; i < numServos; i++)
+    ax12write(AX_TORQUE_ENABLE);
+    ax12write(1);
+    for (uint8_t i = 0; i < SERVOCOUNT; i++)
     {
-        temp = desired_position[i];
-        checksum += (temp & 0xff) + (temp >> 8) + id[i];
+        if (!((mask >> i) & 1))
+            continue;
+        checksum += id[i] + enable;
         ax12write(id[i]);
-        ax12write(temp & 0xff);
-        ax12write(temp >> 8);
+        ax12write(enable);
     }
     ax12write(0xff - (checksum % 256));
     setRX(0);
@@ -890,15 +2956,17 @@ void WidowX::syncWrite(uint8_t numServos)
 */
 uint8_t WidowX::getIK_Q4(float Px, float Py, float Pz)
 {
+    PROFILE_SCOPE(PROBE_IK_Q4);
+    float q2, q3, a, b, c, cond;
     //Obtain q1
-    q1 = atan2(Py, Px);
+    const float q1 = atan2(Py, Px);
 
     //Obtain point as seen from {1}
     const float X = sqrt(pow(Px, 2) + pow(Py, 2));
     const float Z = Pz - L0;
 
     //Read the angle of the fourth motor (q4) and obtain its sine and cosine
-    q4 = current_angle[3]; //getServoAngle(3);
+    const float q4 = current_angle[3]; //getServoAngle(3);
     const float s4 = sin(q4), c4 = cos(q4);
 
     //Calculate the parameters needed to obtain q3
@@ -959,6 +3027,8 @@ uint8_t WidowX::getIK_Q4(float Px, float Py, float Pz)
         break;
     }
 
+    ik_branch = !tryTwice;
+
     //Save articular values into the array that will set the next positions
     desired_angle[0] = q1;
     desired_angle[1] = q2;
@@ -972,22 +3042,138 @@ uint8_t WidowX::getIK_Q4(float Px, float Py, float Pz)
 
 /**
  * Obtains the IK with a desired angle gamma for the gripper. 
- * Returns 0 if succeeds, returns 1 if fails
+ * Returns 0 if succeeds, returns 1 if fails. The solutions are kept in a cache, so a target
+ * that was solved before gets the same angles without any trig. Only exact repeats hit it
 */
 uint8_t WidowX::getIK_Gamma(float Px, float Py, float Pz, float gamma)
 {
+    PROFILE_SCOPE(PROBE_IK_GAMMA);
+#if IK_CACHE_SETS > 0
+    const float key[4] = {Px, Py, Pz, gamma};
+    IKCacheEntry *entry = findIK(key);
+    if (entry != NULL)
+    {
+        ik_cache_hits++;
+        for (uint8_t i = 0; i < 4; i++)
+            desired_angle[i] = entry->angle[i];
+        desired_angle[4] = current_angle[4];
+        desired_angle[5] = current_angle[5];
+        ik_branch = entry->branch;
+        return 0;
+    }
+    ik_cache_misses++;
+    const uint8_t result = computeIK_Gamma(Px, Py, Pz, gamma);
+    if (!result)
+        storeIK(key);
+    return result;
+#else
+    ik_cache_misses++;
+    return computeIK_Gamma(Px, Py, Pz, gamma);
+#endif
+}
+
+#if IK_CACHE_SETS > 0
+/*
+ * Set of the cache where the target in key goes, from the bits of its four floats
+*/
+uint16_t WidowX::ikCacheSet(const float *key)
+{
+    union
+    {
+        float f;
+        uint32_t u;
+    } bits;
+    uint32_t h = 2166136261UL;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        bits.f = key[i];
+        h = (h ^ bits.u) * 16777619UL;
+    }
+    return (h ^ (h >> 16)) & (IK_CACHE_SETS - 1);
+}
+
+/*
+ * Looks for the target in key in the cache. Returns its entry, marked as the most recently
+ * used, or NULL if it is not there
+*/
+IKCacheEntry *WidowX::findIK(const float *key)
+{
+    IKCacheEntry *set = ik_cache[ikCacheSet(key)];
+    for (uint8_t w = 0; w < IK_CACHE_WAYS; w++)
+    {
+        IKCacheEntry *entry = &set[w];
+        if (entry->used && entry->key[0] == key[0] && entry->key[1] == key[1] &&
+            entry->key[2] == key[2] && entry->key[3] == key[3])
+        {
+            entry->stamp = ++ik_cache_clock;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Saves the solution in desired_angle for the target in key in place of the empty or least
+ * recently used entry of its set
+*/
+void WidowX::storeIK(const float *key)
+{
+    IKCacheEntry *set = ik_cache[ikCacheSet(key)];
+    IKCacheEntry *entry = &set[0];
+    for (uint8_t w = 0; w < IK_CACHE_WAYS && entry->used; w++)
+        if (!set[w].used || (uint16_t)(ik_cache_clock - set[w].stamp) > (uint16_t)(ik_cache_clock - entry->stamp))
+            entry = &set[w];
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        entry->key[i] = key[i];
+        entry->angle[i] = desired_angle[i];
+    }
+    entry->used = 1;
+    entry->branch = ik_branch;
+    entry->stamp = ++ik_cache_clock;
+}
+#endif
+
+/*
+ * Solves the IK with a desired angle gamma for the gripper, as getIK_Gamma, without 
+ * looking into the cache
+*/
+uint8_t WidowX::computeIK_Gamma(float Px, float Py, float Pz, float gamma)
+{
+    float q[3];
+    if (solveElbow(sqrt(pow(Px, 2) + pow(Py, 2)), Pz - L0, gamma, q, &ik_branch))
+        return 1;
+
+    //Save articular values into the array that will set the next positions
+    desired_angle[0] = atan2(Py, Px);
+    desired_angle[1] = q[0];
+    desired_angle[2] = q[1];
+    desired_angle[3] = q[2];
+    desired_angle[4] = current_angle[4]; //getServoAngle(4);
+    desired_angle[5] = current_angle[5]; //getServoAngle(5);
+    //Returns with success
+    return 0;
+}
+
+/*
+ * Solves Q2, Q3 and Q4 for a point at the horizontal distance r from the base and the height
+ * z over {1}, with the angle gamma of the gripper. Only gamma changes the trig of the wrist, so
+ * searching for gamma calls it with the same r and z. On success, writes Q2, Q3 and Q4 into q
+ * and the branch of Q3 into branch and returns 0. Returns 1 if there is no solution
+*/
+uint8_t WidowX::solveElbow(float r, float z, float gamma, float *q, uint8_t *branch)
+{
+    float q2, q3, q4, a, b;
     //Calculate sine and cosine of gamma
     const float sg = sin(gamma), cg = cos(gamma);
 
     //Obtain the desired point as seen from {1}
-    const float X = sqrt(pow(Px, 2) + pow(Py, 2)) - L4 * cg;
-    const float Z = Pz - L0 + L4 * sg;
-
-    //Obtain q1
-    q1 = atan2(Py, Px);
+    const float X = r - L4 * cg;
+    const float Z = z + L4 * sg;
 
     //calculate condition for q3
-    c = (pow(X, 2) + pow(Z, 2) - pow(D, 2) - pow(L3, 2)) / (2 * D * L3);
+    const float c = (pow(X, 2) + pow(Z, 2) - pow(D, 2) - pow(L3, 2)) / (2 * D * L3);
 
     if (abs(c) > 1)
         return 1;
@@ -1065,19 +3251,16 @@ uint8_t WidowX::getIK_Gamma(float Px, float Py, float Pz, float gamma)
         break;
     }
 
-    //Save articular values into the array that will set the next positions
-    desired_angle[0] = q1;
-    desired_angle[1] = q2;
-    desired_angle[2] = q3;
-    desired_angle[3] = q4;
-    desired_angle[4] = current_angle[4]; //getServoAngle(4);
-    desired_angle[5] = current_angle[5]; //getServoAngle(5);
-    //Returns with success
+    *branch = !tryTwice;
+    q[0] = q2;
+    q[1] = q3;
+    q[2] = q4;
     return 0;
 }
 
 uint8_t WidowX::getIK_Rd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
 {
+    PROFILE_SCOPE(PROBE_IK_RD);
     const float gamma = atan2(-Rd(2, 0), Rd(0, 0));
 
     //Do getIK_Gamma and check if it succeeds. If not, it returns 1
@@ -1089,7 +3272,7 @@ uint8_t WidowX::getIK_Rd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
     roty(gamma, RyGamma);
     Invert(RyGamma);
     Matrix<3, 3> Rx5 = RyGamma * Rd;
-    q5 = atan2(Rx5(2, 1), Rx5(1, 1));
+    const float q5 = atan2(Rx5(2, 1), Rx5(1, 1));
 
     //Save q5 into the desired_angle array. the other values
     //Have already been saved by getIKGamma
@@ -1100,8 +3283,9 @@ uint8_t WidowX::getIK_Rd(float Px, float Py, float Pz, Matrix<3, 3> &Rd)
 
 uint8_t WidowX::getIK_RdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase)
 {
+    PROFILE_SCOPE(PROBE_IK_RDBASE);
     //Obtain the desired rotation as seen from {1} to use it with getIK_Rd
-    q1 = atan2(Py, Px);
+    const float q1 = atan2(Py, Px);
     Matrix<3, 3> RzQ1;
     rotz(q1, RzQ1);
     Invert(RzQ1);
@@ -1116,18 +3300,31 @@ uint8_t WidowX::getIK_RdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase)
 */
 uint8_t WidowX::getIK_Gamma_Controller(float Px, float Py, float Pz, float gamma)
 {
+    return getIK_Polar_Controller(sqrt(pow(Px, 2) + pow(Py, 2)), atan2(Py, Px), Pz, gamma);
+}
+
+/**
+ * Obtains the IK with a desired angle gamma for the gripper of a point given by its distance
+ * radius to the axis of Q1, the angle theta around it and the height Pz. Q1 is theta itself, 
+ * so the controller in polar coordinates needs no atan2 nor sqrt.
+ * Returns 0 if succeeds, returns 1 if fails
+*/
+uint8_t WidowX::getIK_Polar_Controller(float radius, float theta, float Pz, float gamma)
+{
+    PROFILE_SCOPE(PROBE_IK_CONTROLLER);
+    float q2, q3, q4, a, b;
     //Calculate sine and cosine of gamma
     const float sg = sin(gamma), cg = cos(gamma);
 
     //Obtain the desired point as seen from {1}
-    const float X = sqrt(pow(Px, 2) + pow(Py, 2)) - L4 * cg;
+    const float X = radius - L4 * cg;
     const float Z = Pz - L0 + L4 * sg;
 
     //Obtain q1
-    q1 = atan2(Py, Px);
+    const float q1 = theta;
 
     //calculate condition for q3
-    c = (pow(X, 2) + pow(Z, 2) - pow(D, 2) - pow(L3, 2)) / (2 * D * L3);
+    const float c = (pow(X, 2) + pow(Z, 2) - pow(D, 2) - pow(L3, 2)) / (2 * D * L3);
 
     if (abs(c) > 1)
         return 1;
@@ -1223,6 +3420,9 @@ uint8_t WidowX::getIK_Gamma_Controller(float Px, float Py, float Pz, float gamma
         break;
     }
 
+    //q3_1 is the first branch; selection tells which one was tried first
+    ik_branch = selection != tryTwice;
+
     //Save articular values into the array that will set the next positions
     desired_angle[0] = q1;
     desired_angle[1] = q2;
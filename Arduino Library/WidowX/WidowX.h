@@ -31,6 +31,8 @@ SOFTWARE.
 #include "Arduino.h"
 #include <ax12.h>
 #include <BasicLinearAlgebra.h>
+#include "profile.h"
+#include "clock.h"
 
 using namespace BLA;
 
@@ -38,6 +40,134 @@ using namespace BLA;
 #define MX_64 1
 #define AX_12 2
 
+#define ALL_SERVOS 0x3F
+#define NO_POSITION 0xFFFF
+
+//Trajectory profiles
+#define TRAJ_CUBIC 0
+#define TRAJ_QUINTIC 1
+#define TRAJ_SCURVE 2
+#define SC_TA 0.3 //fraction of the move spent accelerating in the S-curve
+#define SC_TJ 0.1 //fraction of the move spent changing the acceleration in the S-curve
+
+//Input shaping
+#define SHAPER_NONE 0
+#define SHAPER_ZV 1
+#define SHAPER_ZVD 2
+#define SHAPER_HISTORY 16 //targets of the speed modes kept to be delayed by the shaper
+
+//Control tick
+//Uncomment to pace the moves with the Timer1 interrupt. It takes the TIMER1_COMPA vector, so it
+//cannot be linked together with Servo.h or TimerOne. When commented, the ticks are scheduled 
+//with micros()
+// #define WIDOWX_TIMER1_TICK
+
+//Thermal governor
+#define GOV_PERIOD 100       //ms between reads of the governor, one servo per read
+#define GOV_TEMP_LIMIT 65    //°C the governor keeps the servos under (they shut down at 70 to 80)
+#define GOV_TEMP_BAND 10     //°C below the limit where the governor starts slowing down
+#define GOV_TAU 300          //thermal time constant of a servo, in seconds
+#define GOV_LOOKAHEAD 60     //seconds ahead the temperature is predicted
+#define GOV_SMOOTHING 20     //seconds over which the readings are averaged
+#define GOV_MIN_SCALE 0.3    //slowest the governor makes the arm
+#define GOV_DWELL_MAX 2000   //ms of pause after a move at GOV_MIN_SCALE
+
+//Gravity compensation
+#define DEFAULT_PUNCH 32 //punch of the MX and AX servos from the factory
+
+//Motion queue
+#define QUEUE_SIZE 8
+#define QUEUE_GAMMA 0
+#define QUEUE_ANGLES 1
+
+//Incremental forward kinematics
+#define FK_DELTA_MAX 0.02  //largest change of an angle, in radians, applied as a rotation (13 positions of an MX)
+#define FK_RENORMALIZE 32 //updates between renormalizations of the sines and cosines
+
+//Calibration
+#define CAL_LUT_POINTS 9        //corrections of a table, evenly spaced over the range of the servo
+#define CAL_EEPROM_ADDRESS 0    //where the calibration is saved in the EEPROM
+#define CAL_MAGIC 0x5743
+
+//Speed modes
+#define PROJECTION_MARGIN 0.01 //cm that a projected wrist is kept inside the boundary
+#define SPEED_DT_MAX 100000    //longest interval between frames, in microseconds, that is integrated
+
+//Search of gamma
+#define GAMMA_SEARCH_STEPS 16      //samples on each side of gamma that bracket the nearest reachable one
+#define GAMMA_SEARCH_ITERATIONS 12 //bisections that refine the bracket
+
+//IK cache
+#ifndef IK_CACHE_SETS
+#if defined(__AVR__)
+#define IK_CACHE_SETS 0   //sets of the cache of getIK_Gamma, a power of 2. 0 removes the cache
+#else
+#define IK_CACHE_SETS 256
+#endif
+#endif
+#ifndef IK_CACHE_WAYS
+#define IK_CACHE_WAYS 2   //entries per set, replaced least recently used first
+#endif
+
+/*
+ * Calibration of the servos, as saved in the EEPROM. The angle of a servo is 
+ * scale * (nominal angle) + offset [rad]. If the bit idx of lut_mask is set, lut[idx] holds
+ * corrections in positions that are interpolated over the range of the servo and 
+ * subtracted from the position read
+*/
+struct Calibration
+{
+    uint16_t magic;
+    float offset[6];
+    float scale[6];
+    uint8_t lut_mask;
+    int8_t lut[6][CAL_LUT_POINTS];
+    uint8_t checksum;
+};
+
+/*
+ * Entry of the IK cache. key holds the exact Px, Py, Pz and gamma of a solved target, and
+ * angle the Q1 to Q4 solved for it, on the branch of Q3 given by branch
+*/
+struct IKCacheEntry
+{
+    float key[4];
+    float angle[4];
+    uint8_t used;
+    uint8_t branch;
+    uint16_t stamp;
+};
+
+/*
+ * Statistics of the control tick periods, in microseconds. 
+ * overruns counts the ticks that were lost because a step took longer than the period
+*/
+struct TickStats
+{
+    unsigned long ticks;
+    unsigned long overruns;
+    unsigned long min_period;
+    unsigned long max_period;
+    unsigned long mean_period;
+    unsigned long max_jitter;
+};
+
+/*
+ * State of the thermal governor. temperature is the last one read [°C], predicted the one
+ * the model expects GOV_LOOKAHEAD seconds ahead and load the last load read, in per mille of
+ * the maximum torque (negative when clockwise). Moves take 1/scale times longer and are
+ * followed by dwell milliseconds of pause
+*/
+struct GovernorStats
+{
+    float temperature[6];
+    float predicted[6];
+    int load[6];
+    float scale;
+    unsigned int dwell;
+    unsigned long reads;
+};
+
 class WidowX
 {
 public:
@@ -53,7 +183,7 @@ public:
     void moveCenter();
     void moveHome();
     void moveRest();
-    void moveToPose(const unsigned int *pose);
+    void moveToPose(const uint16_t *pose);
 
     //Get Information
     void checkVoltage();
@@ -62,10 +192,53 @@ public:
     int getServoPosition(int idx);
     float getServoAngle(int idx);
     void getPoint(float *p);
+    void getPose(float *p, Matrix<3, 3> &R);
+    void getPointFast(float *p);
+
+    //Calibration
+    void setCalibration(int idx, float offset, float scale);
+    void setCalibrationTable(int idx, const int8_t *corrections);
+    void clearCalibration();
+    uint8_t loadCalibration();
+    void saveCalibration();
+
+    //Arrival
+    long waitForArrival(uint8_t tolerance, unsigned int timeout);
+    void setArrivalTolerance(uint8_t tolerance, unsigned int timeout);
+    long getSettleTime();
+
+    //Bus Traffic
+    void setDeadband(int idx, uint8_t positions);
+    void setDeadband(uint8_t positions);
+    unsigned long getBytesSent();
+    unsigned long getBytesSaved();
+    void resetBusStats();
+    void setVelocityFeedforward(uint8_t enable);
+    void setTrajectoryProfile(uint8_t profile);
+    void setInputShaper(uint8_t type, float frequency, float damping);
+    int getShaperDelay();
+
+    //Gravity Compensation
+    void setGravityCompensation(uint8_t enable, uint8_t adjustPunch);
+    void setLinkMasses(float upperArm, float forearm, float wrist);
+    void setPayload(float mass);
+    void setJointStiffness(int idx, float stiffness);
+
+    //Control Tick
+    void setControlPeriod(unsigned long period_us);
+    void getTickStats(TickStats *stats);
+    void resetTickStats();
+
+    //Thermal Governor
+    void setGovernor(uint8_t enable);
+    void updateGovernor();
+    void getGovernorStats(GovernorStats *stats);
 
     //Torque
     void relaxServos();
+    void relaxServos(uint8_t mask);
     void torqueServos();
+    void torqueServos(uint8_t mask);
 
     //Move Servo
     void moveServo2Angle(int idx, float angle);
@@ -73,21 +246,54 @@ public:
     void moveGrip(int close);
     void setServo2Position(int idx, int position);
     void moveServoWithSpeed(int idx, int speed, long initial_time);
+    void moveServoWithSpeed(int idx, int speed);
 
     //Move Arm
     void movePointWithSpeed(int vx, int vy, int vz, int vg, long initial_time);
     void moveArmWithSpeed(int vx, int vy, int vz, int vg, long initial_time);
-    void moveArmQ4(float Px, float Py, float Pz);
-    void moveArmQ4(float Px, float Py, float Pz, int time);
-    void moveArmGamma(float Px, float Py, float Pz, float gamma);
-    void moveArmGamma(float Px, float Py, float Pz, float gamma, int time);
-    void moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd);
-    void moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd, int time);
-    void moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase);
-    void moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase, int time);
+    void movePointWithSpeed(int vx, int vy, int vz, int vg);
+    void moveArmWithSpeed(int vx, int vy, int vz, int vg);
+    void setSpeedProjection(uint8_t enable);
+    uint8_t moveArmQ4(float Px, float Py, float Pz);
+    uint8_t moveArmQ4(float Px, float Py, float Pz, int time);
+    uint8_t moveArmGamma(float Px, float Py, float Pz, float gamma);
+    uint8_t moveArmGamma(float Px, float Py, float Pz, float gamma, int time);
+    void setGammaSearch(float window);
+    float getChosenGamma();
+    uint8_t moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd);
+    uint8_t moveArmRd(float Px, float Py, float Pz, Matrix<3, 3> &Rd, int time);
+    uint8_t moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase);
+    uint8_t moveArmRdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase, int time);
+
+    //Retargeting
+    uint8_t retargetArmGamma(float Px, float Py, float Pz, float gamma, int time);
+    void retargetAngles(const float *angles, int time);
+    uint8_t updateMotion();
+    uint8_t isMoving();
 
     //Sequence
-    void performSequenceGamma(float[][] seq, int num_poses);
+    void performSequenceGamma(float seq[][5], int num_poses);
+
+    //Motion Queue
+    uint8_t queueArmGamma(float Px, float Py, float Pz, float gamma, int time, float tolerance);
+    uint8_t queueAngles(const float *angles, int time, float tolerance);
+    uint8_t updateQueue();
+    void runQueue();
+    void clearQueue();
+    uint8_t queueLength();
+    unsigned long getDroppedMoves();
+
+    //Kinematics
+    uint8_t solveIK_Gamma(float Px, float Py, float Pz, float gamma, float *angles);
+    uint8_t solveIK_Rd(float Px, float Py, float Pz, Matrix<3, 3> &Rd, float *angles);
+    uint8_t getIKBranch();
+    float getLimitMargin(const float *angles);
+    uint8_t findGamma(float Px, float Py, float Pz, float *gamma, float window);
+    void clearIKCache();
+    void getIKCacheStats(unsigned long *hits, unsigned long *misses);
+    void solveFK(const float *angles, float *pose);
+    void solvePose(const float *angles, float *p, Matrix<3, 3> &R);
+    void quantizeAngles(float *angles, uint8_t numServos);
 
     //Rotations
     void rotz(float angle, Matrix<3, 3> &Rz);
@@ -100,6 +306,7 @@ private:
     const float L0, L1, L2, L3, L4, D, alpha;
     const float sa, ca; //sin(alpha), cos(alpha);
     const int DEFAULT_TIME;
+    const uint8_t DEFAULT_TOLERANCE = 10;
     //Limits
     const float xy_lim = 43.0;
     const float z_lim_up = 52.0;
@@ -110,6 +317,11 @@ private:
     const float Kp = 60.0 / 127000;   //[cm/(ms*bit)]
     const float Kg = M_PI_2 / 255000; //[rad/(ms*bit)]
     const float Ks = 1024.0 / 255000; //[pos/(ms*bit)]
+    const float Kv_MX = 60000.0 / (4096 * 0.114);   //[speed unit/(pos/ms)], 0.114rpm per unit
+    const float Kv_AX = 60000.0 / (1228.8 * 0.111); //[speed unit/(pos/ms)], 0.111rpm per unit
+
+    //Stall torque [g*cm] of Q1 to Q4 at 12V: MX-28, MX-64, MX-64, MX-28
+    const float stall_torque[4] = {25500, 61200, 61200, 25500};
 
     //Variables
     uint8_t id[6];
@@ -118,24 +330,151 @@ private:
     float float_position[6];
     float current_angle[6];
     float desired_angle[6];
+    uint8_t ik_branch;
     uint16_t desired_position[6];
     uint16_t next_position[6];
+    uint16_t next_speed[6];
+    uint16_t last_sent[6];
+    uint16_t last_speed[6];
+    uint8_t velocity_ff;
+    uint8_t arrival_tolerance;
+    unsigned int arrival_timeout;
+    long settle_time;
+    int arrival_offset[6];
+    uint8_t gravity_comp, gravity_punch, punch_raised;
+    float link_mass[3];
+    float payload_mass;
+    float joint_stiffness[4];
+    uint8_t motion_active;
+    uint8_t settle_active, settle_pending;
+    unsigned long settle_start;
+    unsigned int settle_dwell;
+    float motion_t, motion_time;
+    unsigned long motion_tick0;
+    uint8_t queue_type[QUEUE_SIZE];
+    float queue_goal[QUEUE_SIZE][5];
+    int queue_time[QUEUE_SIZE];
+    float queue_tolerance[QUEUE_SIZE];
+    uint8_t queue_profile[QUEUE_SIZE];
+    uint8_t queue_head, queue_count;
+    unsigned long queue_dropped;
+    uint8_t active_type;
+    float active_goal[5];
+    float active_tolerance;
+    uint8_t deadband[6];
+    unsigned long bus_bytes_sent;
+    unsigned long bus_bytes_saved;
+    unsigned long tick_period;
+    unsigned long tick_last_stamp;
+    unsigned long tick_last_count;
+    unsigned long tick_deadline;
+    unsigned long tick_period_sum;
+    uint8_t tick_tccr1a, tick_tccr1b;
+    uint8_t tick_hardware;
+    TickStats tick_stats;
     float point[3];
+    float fk_cos[4], fk_sin[4];
+    float fk_angle[4];
+    Calibration calibration;
+    float angle_gain[6], position_gain[6], zero_position[6];
+    uint8_t fk_valid, fk_updates;
+#if IK_CACHE_SETS > 0
+    IKCacheEntry ik_cache[IK_CACHE_SETS][IK_CACHE_WAYS];
+    uint16_t ik_cache_clock;
+#endif
+    unsigned long ik_cache_hits, ik_cache_misses;
     float speed_points[3];
+    float speed_polar[2];
+    uint8_t speed_is_polar;
+    uint8_t speed_projection;
+    unsigned long speed_stamp;
+    unsigned long servo_speed_stamp[6];
+    float accepted_point[4];
+    uint8_t accepted_polar;
     float global_gamma;
-    float W[6][4];
+    float gamma_window, chosen_gamma;
+    float W[6][6];
+    uint8_t trajectory_profile, motion_profile;
+    uint8_t shaper_impulses;
+    float shaper_amplitude[3], shaper_delay[3];
+    unsigned long shaper_spacing;
+    unsigned long shaper_stamp[SHAPER_HISTORY];
+    uint16_t shaper_target[SHAPER_HISTORY][4];
+    uint8_t shaper_head, shaper_count;
+    uint16_t speed_target[4];
+    uint8_t gov_enabled, gov_next;
+    unsigned long gov_last, gov_stamp[6], gov_reads;
+    float gov_ambient;
+    float gov_temperature[6], gov_measured[6], gov_rate[6], gov_gain[6], gov_load2[6], gov_predicted[6];
+    int gov_load[6];
+    float gov_scale;
+    unsigned int gov_dwell;
 
     //Conversions
     float positionToAngle(int idx, int position);
     int angleToPosition(int idx, float angle);
+    void applyCalibration(int idx);
+    float tableCorrection(int idx, float position);
+    uint8_t calibrationChecksum();
 
     //Poses and interpolation
     void updatePoint();
+    void forwardKinematics(const float *q, float *p);
+    void trackPoint(float *p);
+    void rotateTrackedAngle(uint8_t k, float angle);
+    void setDesiredPositions(uint8_t numServos, uint8_t adjustPunch);
+    void gravityTorque(const float *q, float *tau);
     void cubeInterpolation(Matrix<4> &params, float *w, int time);
+    void quinticInterpolation(float p0, float pf, float v0, float a0, float *w, int time);
+    void sCurve(float tau, float *s, float *v, float *a);
+    void planJoint(uint8_t i, float p0, float pf, float v0, float a0, int time, uint8_t profile);
     void interpolate(int remainingTime);
-    void interpolateFromPose(const unsigned int *pose, int remainingTime);
+    void interpolateFromPose(const uint16_t *pose, int remainingTime);
+    void streamTrajectory(int remTime);
+    void beginTrajectory(int remTime);
+    uint8_t stepTrajectory();
+    void writeGoal();
+    void sendTrajectorySample(float t);
+    void retarget(int time);
+    void startNextQueued();
+    uint8_t withinTolerance();
+    float trajectoryPosition(uint8_t i, float t);
+    float trajectoryVelocity(uint8_t i, float t);
+    float trajectoryAcceleration(uint8_t i, float t);
+    float shapedTrajectory(uint8_t i, float t, uint8_t order);
+    void sendSpeedTarget(uint8_t push);
+    void pushSpeedTarget(unsigned long now);
+    void delayedSpeedTarget(unsigned long now, unsigned long delay, float *position);
+    uint16_t speedToRegister(int idx, float velocity);
+    float speedInterval(unsigned long *stamp);
+    void stepServoWithSpeed(int idx, int speed, float tf);
+    void stepPointWithSpeed(int vx, int vy, int vz, int vg, float tf);
+    void stepArmWithSpeed(int vx, int vy, int vz, int vg, float tf);
     void setArmGamma(float Px, float Py, float Pz, float gamma);
-    void syncWrite(uint8_t numServos);
+    void setArmPolar(float radius, float theta, float Pz, float gamma);
+    void acceptSpeedTarget(float a, float b, float Pz, float gamma);
+    void rejectSpeedTarget();
+    void speedToPolar();
+    void speedToCartesian();
+    void projectToWorkspace();
+    void syncWrite(const uint16_t *positions, const uint16_t *speeds, uint8_t numServos, uint8_t useDeadband);
+    void writePosition(uint8_t idx, int position);
+    void syncWriteTorque(uint8_t enable, uint8_t mask);
+
+    //Arrival
+    uint8_t pollArrival(uint8_t pending, uint8_t tolerance);
+    void beginSettle();
+    uint8_t stepSettle();
+
+    //Control tick
+    void startTick();
+    void stopTick();
+    unsigned long waitTick();
+    uint8_t tickPending();
+
+    //Thermal governor
+    void readGovernor(uint8_t idx);
+    int governedTime(int time);
 
     //Inverse Kinematics
     uint8_t getIK_Q4(float Px, float Py, float Pz);
@@ -143,6 +482,15 @@ private:
     uint8_t getIK_Rd(float Px, float Py, float Pz, Matrix<3, 3> &Rd);
     uint8_t getIK_RdBase(float Px, float Py, float Pz, Matrix<3, 3> &RdBase);
     uint8_t getIK_Gamma_Controller(float Px, float Py, float Pz, float gamma);
+    uint8_t getIK_Polar_Controller(float radius, float theta, float Pz, float gamma);
+    uint8_t computeIK_Gamma(float Px, float Py, float Pz, float gamma);
+    uint8_t solveElbow(float r, float z, float gamma, float *q, uint8_t *branch);
+    uint8_t searchGamma(float Px, float Py, float Pz, float *gamma);
+#if IK_CACHE_SETS > 0
+    uint16_t ikCacheSet(const float *key);
+    IKCacheEntry *findIK(const float *key);
+    void storeIK(const float *key);
+#endif
 };
 
 #endif
@@ -0,0 +1,104 @@
+/*
+clock.cpp - Time source of the WidowX library, real or virtual
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include "Arduino.h"
+#include "clock.h"
+
+//////////////////////////////////////////////////////////////////////////////////////
+/*
+    *** GLOBAL VARIABLES ***
+*/
+uint8_t virtual_clock = 0;
+unsigned long virtual_us = 0;
+
+//////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Selects the virtual clock (enable != 0) or the real one. The virtual clock starts at 0
+*/
+void setVirtualClock(uint8_t enable)
+{
+    virtual_clock = enable;
+    virtual_us = 0;
+}
+
+uint8_t isVirtualClock()
+{
+    return virtual_clock;
+}
+
+/*
+ * Advances the virtual clock by the given microseconds. It does nothing with the real clock
+*/
+void advanceClock(unsigned long us)
+{
+    if (virtual_clock)
+        virtual_us += us;
+}
+
+unsigned long clockMillis()
+{
+    if (virtual_clock)
+        return virtual_us / 1000;
+    return millis();
+}
+
+unsigned long clockMicros()
+{
+    if (virtual_clock)
+        return virtual_us;
+    return micros();
+}
+
+void clockDelay(unsigned long ms)
+{
+    if (virtual_clock)
+        virtual_us += ms * 1000;
+    else
+        delay(ms);
+}
+
+void clockDelayMicroseconds(unsigned long us)
+{
+    if (virtual_clock)
+        virtual_us += us;
+    else if (us > 16383) //largest value that delayMicroseconds() handles accurately
+    {
+        delay(us / 1000);
+        delayMicroseconds(us % 1000);
+    }
+    else
+        delayMicroseconds(us);
+}
+
+/*
+ * Called inside polling loops. With the virtual clock, nothing else would make the time advance,
+ * so it advances it by one millisecond; with the real clock it does nothing
+*/
+void clockYield()
+{
+    if (virtual_clock)
+        virtual_us += 1000;
+}
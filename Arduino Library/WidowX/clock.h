@@ -0,0 +1,48 @@
+/*
+clock.h - Time source of the WidowX library, real or virtual
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef clock_h
+#define clock_h
+
+#include "Arduino.h"
+
+/*
+ * Every time the library reads the time or waits, it does it through these functions. With the
+ * real clock (default) they are millis(), micros(), delay() and delayMicroseconds(). With the 
+ * virtual clock, time only advances when the library (or the sketch) waits, and waiting returns
+ * immediately, so motion scripts run deterministically and much faster than real time
+*/
+void setVirtualClock(uint8_t enable);
+uint8_t isVirtualClock();
+void advanceClock(unsigned long us);
+
+unsigned long clockMillis();
+unsigned long clockMicros();
+void clockDelay(unsigned long ms);
+void clockDelayMicroseconds(unsigned long us);
+void clockYield();
+
+#endif
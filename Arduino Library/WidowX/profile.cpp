@@ -0,0 +1,98 @@
+/*
+profile.cpp - Timing probes to profile the WidowX library on the ArbotiX
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include "Arduino.h"
+#include "profile.h"
+
+#ifdef WIDOWX_PROFILE
+
+//////////////////////////////////////////////////////////////////////////////////////
+/*
+    *** GLOBAL VARIABLES ***
+*/
+unsigned long probe_count[NUM_PROBES];
+unsigned long probe_total[NUM_PROBES];
+unsigned long probe_min[NUM_PROBES];
+unsigned long probe_max[NUM_PROBES];
+const char *const probe_name[NUM_PROBES] = {
+    "getIK_Q4", "getIK_Gamma", "getIK_Rd", "getIK_RdBase", "getIK_Gamma_Controller",
+    "updatePoint", "angleToPosition", "syncWrite", "getServoPosition", "parser", "user"};
+
+//////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Accumulates the elapsed time in microseconds into the given probe
+*/
+void profileRecord(uint8_t probe, unsigned long elapsed)
+{
+    if (probe >= NUM_PROBES)
+        return;
+    if (probe_count[probe] == 0 || elapsed < probe_min[probe])
+        probe_min[probe] = elapsed;
+    if (elapsed > probe_max[probe])
+        probe_max[probe] = elapsed;
+    probe_total[probe] += elapsed;
+    probe_count[probe]++;
+}
+
+/*
+ * Prints through the serial port the calls, minimum, average and maximum time in
+ * microseconds of every probe that has been hit. The resolution is the one of micros(),
+ * which is 4us on the 16MHz ArbotiX
+*/
+void profileDump()
+{
+    Serial.println("probe, calls, min[us], avg[us], max[us]");
+    for (uint8_t i = 0; i < NUM_PROBES; i++)
+    {
+        if (probe_count[i] == 0)
+            continue;
+        Serial.print(probe_name[i]);
+        Serial.print(", ");
+        Serial.print(probe_count[i]);
+        Serial.print(", ");
+        Serial.print(probe_min[i]);
+        Serial.print(", ");
+        Serial.print(probe_total[i] / probe_count[i]);
+        Serial.print(", ");
+        Serial.println(probe_max[i]);
+    }
+}
+
+/*
+ * Clears every probe
+*/
+void profileReset()
+{
+    for (uint8_t i = 0; i < NUM_PROBES; i++)
+    {
+        probe_count[i] = 0;
+        probe_total[i] = 0;
+        probe_min[i] = 0;
+        probe_max[i] = 0;
+    }
+}
+
+#endif
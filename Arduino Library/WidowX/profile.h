@@ -0,0 +1,81 @@
+/*
+profile.h - Timing probes to profile the WidowX library on the ArbotiX
+ 
+ MIT License
+
+Copyright (c) 2020 LeninSG21
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef profile_h
+#define profile_h
+
+#include "Arduino.h"
+
+//Uncomment to compile the timing probes into the library and the sketches.
+//When commented, PROFILE_SCOPE() expands to nothing and costs nothing
+// #define WIDOWX_PROFILE
+
+//Probes
+#define PROBE_IK_Q4 0
+#define PROBE_IK_GAMMA 1
+#define PROBE_IK_RD 2
+#define PROBE_IK_RDBASE 3
+#define PROBE_IK_CONTROLLER 4
+#define PROBE_UPDATE_POINT 5
+#define PROBE_ANGLE_TO_POSITION 6
+#define PROBE_SYNC_WRITE 7
+#define PROBE_GET_SERVO_POSITION 8
+#define PROBE_PARSER 9
+#define PROBE_USER 10
+#define NUM_PROBES 11
+
+#ifdef WIDOWX_PROFILE
+
+void profileRecord(uint8_t probe, unsigned long elapsed);
+void profileDump();
+void profileReset();
+
+/*
+ * Measures the time between its construction and the end of the scope where it lives,
+ * and accumulates it into the given probe
+*/
+class ProfileProbe
+{
+public:
+    ProfileProbe(uint8_t probe) : probe(probe), start(micros()) {}
+    ~ProfileProbe() { profileRecord(probe, micros() - start); }
+
+private:
+    uint8_t probe;
+    unsigned long start;
+};
+
+#define PROFILE_SCOPE(probe) ProfileProbe profile_probe(probe)
+
+#else
+
+#define PROFILE_SCOPE(probe)
+inline void profileDump() {}
+inline void profileReset() {}
+
+#endif
+
+#endif